@@ -4,53 +4,141 @@
 #include <stdlib.h>
 #include <string.h>
 #include "ast.h"
+#include "compilation.h"
 #include "tables.h"
 #include "types.h"
 
-#define CHILDREN_LIMIT 200 // Don't try this at home, kids... :P
+// AST arena -----------------------------------------------------------------
+
+// Todos os nós (e seus vetores de filhos) são alocados sequencialmente em
+// blocos grandes. Não existe liberação individual: free_arena devolve a arena
+// inteira de uma vez. Cada bloco novo tem o dobro do tamanho do anterior, então
+// o número de blocos cresce só logaritmicamente com o tamanho da árvore.
+// Cada compilação tem a sua arena; new_node usa a que foi escolhida por
+// use_arena na thread corrente, de modo que threads diferentes podem montar
+// árvores diferentes ao mesmo tempo.
+
+#define ARENA_FIRST_BLOCK_SIZE (16 * 1024)
+#define ARENA_ALIGN sizeof(void*)
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t cap;
+    char data[];
+} ArenaBlock;
+
+struct arena {
+    ArenaBlock* blocks;
+    size_t next_cap;
+};
+
+static _Thread_local Arena* arena = NULL;
+
+Arena* create_arena(void) {
+    Arena* a = malloc(sizeof * a);
+    a->blocks = NULL;
+    a->next_cap = ARENA_FIRST_BLOCK_SIZE;
+    return a;
+}
+
+void use_arena(Arena* a) {
+    arena = a;
+}
+
+void free_arena(Arena* a) {
+    while (a->blocks != NULL) {
+        ArenaBlock* next = a->blocks->next;
+        free(a->blocks);
+        a->blocks = next;
+    }
+    if (arena == a) {
+        arena = NULL;
+    }
+    free(a);
+}
+
+static void* arena_alloc(size_t bytes) {
+    bytes = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->used + bytes > block->cap) {
+        size_t cap = arena->next_cap;
+        while (cap < bytes) {
+            cap *= 2;
+        }
+        block = malloc(sizeof * block + cap);
+        if (block == NULL) {
+            fprintf(stderr, "Out of memory while building the AST!\n");
+            exit(1);
+        }
+        block->next = arena->blocks;
+        block->used = 0;
+        block->cap = cap;
+        arena->blocks = block;
+        arena->next_cap = cap * 2;
+    }
+    void* p = block->data + block->used;
+    block->used += bytes;
+    return p;
+}
+
+// AST nodes ------------------------------------------------------------------
 
 struct node {
     NodeKind kind;
     int data; /* Se kind é variável ou função, data representa a posição na respectiva tabela. Se é número, representa o número. */
     int count;
-    AST* child[CHILDREN_LIMIT];
+    int capacity;
+    NodeHandler handler; /* Preenchido pelo link_ast do interpretador. */
+    Storage storage; /* Preenchidos pelo resolve do interpretador em nós de variável. */
+    int slot;
+    AST** child; /* Aponta logo após o nó enquanto couber; cresce para outra região da arena. */
 };
 
-AST* new_node(NodeKind kind, int data) {
-    AST* node = malloc(sizeof * node);
+// Aloca o nó já com espaço para 'capacity' filhos logo em seguida.
+static AST* alloc_node(NodeKind kind, int data, int capacity) {
+    AST* node = arena_alloc(sizeof * node + capacity * sizeof(AST*));
     node->kind = kind;
     node->data = data;
     node->count = 0;
-    for (int i = 0; i < CHILDREN_LIMIT; i++) {
-        node->child[i] = NULL;
-    }
+    node->capacity = capacity;
+    node->handler = NULL;
+    node->storage = NO_STORAGE;
+    node->slot = 0;
+    node->child = (AST**) (node + 1);
     return node;
 }
 
+AST* new_node(NodeKind kind, int data) {
+    return alloc_node(kind, data, 0);
+}
+
 void add_child(AST *parent, AST *child) {
     if(parent == NULL){
         printf("Pai nulo. Algo está errado.\n");
         return;
     }
-    if (parent->count == CHILDREN_LIMIT) {
-        fprintf(stderr, "Cannot add another child!\n");
-        exit(1);
+    if (parent->count == parent->capacity) {
+        int capacity = parent->capacity == 0 ? 1 : 2 * parent->capacity;
+        AST** grown = arena_alloc(capacity * sizeof(AST*));
+        memcpy(grown, parent->child, parent->count * sizeof(AST*));
+        parent->child = grown;
+        parent->capacity = capacity;
     }
     parent->child[parent->count] = child;
     parent->count++;
 }
 
 AST* get_child(AST *parent, int idx) {
-    return parent->child[idx];
+    return idx < parent->count ? parent->child[idx] : NULL;
 }
 
-AST* new_subtree(NodeKind kind, int child_count, ...) {
-    if (child_count > CHILDREN_LIMIT) {
-        fprintf(stderr, "Too many children as arguments!\n");
-        exit(1);
-    }
+void set_child(AST *parent, int idx, AST *child) {
+    parent->child[idx] = child;
+}
 
-    AST* node = new_node(kind, 0);
+AST* new_subtree(NodeKind kind, int child_count, ...) {
+    AST* node = alloc_node(kind, 0, child_count);
     va_list ap;
     va_start(ap, child_count);
     for (int i = 0; i < child_count; i++) {
@@ -64,6 +152,10 @@ NodeKind get_kind(AST *node) {
     return node->kind;
 }
 
+void set_kind(AST *node, NodeKind kind) {
+    node->kind = kind;
+}
+
 int get_data(AST *node) {
     return node->data;
 }
@@ -72,20 +164,31 @@ int get_child_count(AST *node) {
     return node->count;
 }
 
-void free_tree(AST *tree) {
-    if (tree == NULL) return;
-    for (int i = 0; i < tree->count; i++) {
-        free_tree(tree->child[i]);
-    }
-    free(tree);
+void set_handler(AST *node, NodeHandler handler) {
+    node->handler = handler;
+}
+
+NodeHandler get_handler(AST *node) {
+    return node->handler;
+}
+
+void set_storage(AST *node, Storage storage, int slot) {
+    node->storage = storage;
+    node->slot = slot;
+}
+
+Storage get_storage(AST *node) {
+    return node->storage;
+}
+
+int get_slot(AST *node) {
+    return node->slot;
 }
 
 // Dot output.
 
 int nr;
 
-extern VarTable *vt;
-extern FuncTable *ft;
 
 char* kind2str(NodeKind kind) {
     switch(kind) {
@@ -121,6 +224,9 @@ char* kind2str(NodeKind kind) {
         case STATEMENT_LIST_NODE: return "stmt_list";
         case WHILE_NODE:    return "while";
         case RETURN_NODE:   return "return";
+        case TAIL_CALL_NODE: return "tail_call";
+        case SHL_NODE:      return "<<";
+        case INLINE_NODE:   return "inline";
         default:            return "ERROR!!";
     }
 }
@@ -133,6 +239,7 @@ int has_data(NodeKind kind) {
         case VAR_USE_NODE:
         case FUNCTION_NAME_NODE:
         case FUNCTION_CALL_NODE:
+        case TAIL_CALL_NODE:
             return 1;
         default:
             return 0;
@@ -155,7 +262,7 @@ int print_node_dot(AST *node) {
         if(node->kind == VAR_USE_NODE || node->kind == VAR_DECL_NODE){
             fprintf(stderr, "(%s, scope = %d)", get_name(vt, node->data), get_scope(vt, node->data));
         }
-        else if(node->kind == FUNCTION_CALL_NODE || node->kind == FUNCTION_NAME_NODE){
+        else if(node->kind == FUNCTION_CALL_NODE || node->kind == TAIL_CALL_NODE || node->kind == FUNCTION_NAME_NODE){
             fprintf(stderr, "(%s)", get_func_name(ft, node->data));
         }
     }
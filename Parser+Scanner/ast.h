@@ -36,6 +36,10 @@ typedef enum {
     STATEMENT_LIST_NODE,
     WHILE_NODE,
     RETURN_NODE,
+    TAIL_CALL_NODE,
+    SHL_NODE,
+    INLINE_NODE, // body of an inlined call: [block, value expression]
+    NODE_KIND_COUNT // not a kind: the number of kinds above
 } NodeKind;
 
 struct node; // Opaque structure to ensure encapsulation.
@@ -46,18 +50,49 @@ AST* new_node(NodeKind kind, int data);
 
 void add_child(AST *parent, AST *child);
 AST* get_child(AST *parent, int idx);
+void set_child(AST *parent, int idx, AST *child);
 
 AST* new_subtree(NodeKind kind, int child_count, ...);
 
 NodeKind get_kind(AST *node);
+void set_kind(AST *node, NodeKind kind);
 char* kind2str(NodeKind kind);
 
 int get_data(AST *node);
 int get_child_count(AST *node);
 
+// Execution handler cached in the node by the interpreter's link pass.
+typedef void (*NodeHandler)(AST *node);
+
+void set_handler(AST *node, NodeHandler handler);
+NodeHandler get_handler(AST *node);
+
+// Where a variable node's value lives, cached by the interpreter's resolve
+// pass so execution doesn't have to look the variable up in the tables.
+typedef enum {
+    NO_STORAGE,
+    FRAME_SLOT, // scalar: slot is its cell in the activation record
+    ARRAY_BASE, // local array: slot is the cell of element 0
+    REF_PARAM,  // array parameter: slot is the cell holding the caller's base address
+} Storage;
+
+void set_storage(AST *node, Storage storage, int slot);
+Storage get_storage(AST *node);
+int get_slot(AST *node);
+
 void print_tree(AST *ast);
 void print_dot(AST *ast);
 
-void free_tree(AST *ast);
+// Memory for AST nodes. Nodes are never freed individually: a tree lives in
+// one arena and goes away with it.
+typedef struct arena Arena;
+
+Arena* create_arena(void);
+
+// From now on, new_node and new_subtree allocate from arena in the calling thread.
+void use_arena(Arena* arena);
+
+// Releases every node allocated from arena at once.
+void free_arena(Arena* arena);
 
 #endif
@@ -0,0 +1,137 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+#include "bytecode.h"
+#include "compilation.h"
+#include "optimizer.h"
+
+typedef struct {
+    char* path;
+    int failed;
+    char message[COMPILE_ERROR_SIZE];
+} BatchItem;
+
+typedef struct {
+    BatchItem* items;
+    int count;
+    int next; // próximo arquivo livre; as threads o disputam com __atomic_fetch_add
+    BatchOptions* options;
+} Batch;
+
+// Mesmo caminho de main() até o bytecode, sem executar.
+static void compile_item(BatchItem* item, BatchOptions* o) {
+    Compilation* c = create_compilation();
+    if (parse_file(c, item->path) == 0 && !o->check_only) {
+        if (lookup_func(ft, find_string(ids, "main")) == -1) {
+            compile_error(c, "no function 'main' to run");
+        }
+        else {
+            optimize(c->root, o->opt_level, o->inline_budget, NULL);
+            free_bytecode(compile_ast(c->root));
+        }
+    }
+    item->failed = c->error[0] != '\0';
+    strcpy(item->message, item->failed ? c->error : "ok");
+    free_compilation(c);
+}
+
+static void* worker(void* arg) {
+    Batch* b = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->count) {
+        compile_item(&b->items[i], b->options);
+    }
+    return NULL;
+}
+
+static int is_source(char* name) {
+    size_t len = strlen(name);
+    return len > 3 && strcmp(name + len - 3, ".cm") == 0;
+}
+
+static int by_path(const void* a, const void* b) {
+    return strcmp(((BatchItem*) a)->path, ((BatchItem*) b)->path);
+}
+
+// Os arquivos .cm de dir, em ordem de nome.
+static BatchItem* list_sources(char* dir, int* count) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        perror(dir);
+        return NULL;
+    }
+    int capacity = 64;
+    BatchItem* items = malloc(capacity * sizeof(BatchItem));
+    *count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (!is_source(entry->d_name)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            items = realloc(items, capacity * sizeof(BatchItem));
+        }
+        BatchItem* item = &items[(*count)++];
+        item->path = malloc(strlen(dir) + strlen(entry->d_name) + 2);
+        sprintf(item->path, "%s/%s", dir, entry->d_name);
+        item->failed = 0;
+        item->message[0] = '\0';
+    }
+    closedir(d);
+    qsort(items, *count, sizeof(BatchItem), by_path);
+    return items;
+}
+
+int compile_dir(char* dir, BatchOptions* options) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Batch b;
+    b.items = list_sources(dir, &b.count);
+    if (b.items == NULL) {
+        return -1;
+    }
+    b.next = 0;
+    b.options = options;
+
+    int jobs = options->jobs > 0 ? options->jobs : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > b.count) {
+        jobs = b.count;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    // A thread principal também compila: são criadas só jobs - 1.
+    pthread_t* threads = malloc(jobs * sizeof(pthread_t));
+    int started = 0;
+    for (int t = 1; t < jobs; t++) {
+        if (pthread_create(&threads[started], NULL, worker, &b) != 0) {
+            break;
+        }
+        started++;
+    }
+    worker(&b);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+
+    int failed = 0;
+    for (int i = 0; i < b.count; i++) {
+        printf("%s: %s\n", b.items[i].path, b.items[i].message);
+        failed += b.items[i].failed;
+        free(b.items[i].path);
+    }
+    free(b.items);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    fprintf(stderr, "%d files, %d with errors, %d threads, %.1f ms\n", b.count, failed, started + 1, ms);
+    return failed;
+}
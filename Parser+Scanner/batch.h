@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Batch compilation of a directory (--dir DIR).
+// ----------------------------------------------------------------------------
+
+// Every .cm file in the directory is compiled in its own Compilation (see
+// compilation.h) by a pool of threads, so the files are parsed, checked,
+// optimized and lowered to bytecode concurrently. Nothing runs: the bytecode
+// is thrown away.
+
+typedef struct {
+    int jobs;          // worker threads; 0 = one per online core
+    int check_only;    // stop after parsing and checking each file
+    int opt_level;     // as -O0/-O1 for a single program
+    int inline_budget;
+} BatchOptions;
+
+// Prints one line per file, in name order: "path: ok" or "path: " followed by
+// the first error, exactly as a single compilation would report it. A summary
+// (files, failures, threads and wall time) goes to stderr.
+// Returns the number of files with errors, or -1 if dir can't be read.
+int compile_dir(char* dir, BatchOptions* options);
+
+#endif // BATCH_H
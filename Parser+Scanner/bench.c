@@ -0,0 +1,440 @@
+// Driver dos benchmarks (make bench).
+// Roda cada programa várias vezes em cada engine do trab5, confere a saída
+// com out2/ e compara a mediana do tempo e o pico de memória com um
+// baseline salvo por uma execução anterior (make bench-baseline).
+
+#include <fcntl.h>
+#include <glob.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_EXE "./trab5"
+#define DEFAULT_BASELINE "bench/baseline.txt"
+#define DEFAULT_WARMUP 1
+#define DEFAULT_REPS 5
+#define DEFAULT_THRESHOLD 10.0 // %
+
+// Abaixo disso a diferença é ruído do fork/exec e do escalonador, não do
+// programa: os programas de in/ rodam em um ou dois milissegundos.
+#define SLACK_MS 2.0
+#define SLACK_KB 1024
+
+#define MAX_ARGS 32
+
+typedef struct {
+    char* name;
+    char* flag; // opção do trab5 que escolhe a engine
+} Engine;
+
+static Engine engines[] = {
+    { "vm",  NULL },
+    { "ast", "--ast" },
+    { "jit", "--jit" },
+};
+
+#define ENGINE_COUNT ((int) (sizeof engines / sizeof engines[0]))
+
+typedef struct {
+    char* name;
+    char* engine;
+    double median_ms;
+    long rss_kb;
+} Result;
+
+static char* exe = DEFAULT_EXE;
+static char* extra_args[MAX_ARGS];
+static int extra_count = 0;
+
+static void usage(char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] [program.cm ...]\n"
+            "  --exe PATH        interpreter to measure (default %s)\n"
+            "  --engine NAME     vm, ast or jit; repeat for several (default: all)\n"
+            "  --arg ARG         pass ARG to every run, e.g. --arg -O1; may be repeated\n"
+            "  --warmup N        unmeasured runs before the measured ones (default %d)\n"
+            "  --reps N          measured runs (default %d)\n"
+            "  --baseline FILE   baseline to compare with or save to (default %s)\n"
+            "  --threshold PCT   fail when the median time or the peak RSS grows by more\n"
+            "                    than PCT%% over the baseline (default %.0f)\n"
+            "  --save            write this run's results as the new baseline\n"
+            "Without programs: primes.cm, fizzbuzz.cm, in/c*.cm and bench/*.cm.\n"
+            "Every output is checked against out2/<name>.out; programs read\n"
+            "input() from in/<name>.in when it exists.\n",
+            argv0, DEFAULT_EXE, DEFAULT_WARMUP, DEFAULT_REPS, DEFAULT_BASELINE, DEFAULT_THRESHOLD);
+    exit(EXIT_FAILURE);
+}
+
+// Programas --------------------------------------------------------------------
+
+static char** programs = NULL;
+static int program_count = 0;
+
+static void add_program(char* path) {
+    programs = realloc(programs, (program_count + 1) * sizeof(char*));
+    programs[program_count++] = strdup(path);
+}
+
+static void add_glob(char* pattern) {
+    glob_t g;
+    if (glob(pattern, 0, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++) {
+            add_program(g.gl_pathv[i]);
+        }
+    }
+    globfree(&g);
+}
+
+// "in/c01.cm" -> "c01"
+static char* program_name(char* path) {
+    char* slash = strrchr(path, '/');
+    char* name = strdup(slash != NULL ? slash + 1 : path);
+    size_t len = strlen(name);
+    if (len > 3 && strcmp(name + len - 3, ".cm") == 0) {
+        name[len - 3] = '\0';
+    }
+    return name;
+}
+
+static char* read_file(char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    size_t cap = 4096;
+    size_t len = 0;
+    char* buf = malloc(cap);
+    size_t n;
+    while ((n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+// Execução ------------------------------------------------------------------
+
+typedef struct {
+    double ms;
+    long rss_kb;
+    int status; // como wait4 devolve
+} Run;
+
+// O tempo é o de relógio, do fork ao fim do wait4: com o tick de 4 ms do
+// kernel, o tempo de CPU do rusage não separa os programas pequenos.
+static Run run_once(char* program, char* engine_flag, char* input, int out_fd) {
+    char* argv[MAX_ARGS + 8];
+    int argc = 0;
+    argv[argc++] = exe;
+    argv[argc++] = program;
+    if (engine_flag != NULL) {
+        argv[argc++] = engine_flag;
+    }
+    for (int i = 0; i < extra_count; i++) {
+        argv[argc++] = extra_args[i];
+    }
+    argv[argc++] = "--input";
+    argv[argc++] = input;
+    argv[argc] = NULL;
+
+    if (ftruncate(out_fd, 0) == -1 || lseek(out_fd, 0, SEEK_SET) == -1) {
+        perror("bench");
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(exe, argv);
+        _exit(127);
+    }
+    Run r;
+    struct rusage ru;
+    if (wait4(pid, &r.status, 0, &ru) == -1) {
+        perror("wait4");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r.ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    r.rss_kb = ru.ru_maxrss;
+    return r;
+}
+
+static int same_output(int out_fd, char* expected, size_t expected_size) {
+    struct stat info;
+    if (fstat(out_fd, &info) == -1 || (size_t) info.st_size != expected_size) {
+        return 0;
+    }
+    char* got = malloc(expected_size + 1);
+    ssize_t n = pread(out_fd, got, expected_size, 0);
+    int same = n == (ssize_t) expected_size && memcmp(got, expected, expected_size) == 0;
+    free(got);
+    return same;
+}
+
+static int by_ms(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Percentil pelo posto mais próximo: o menor tempo que cobre p% das execuções.
+static double percentile(double* sorted, int n, double p) {
+    int rank = (int) ceil(p / 100.0 * n);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Baseline ------------------------------------------------------------------
+
+// Uma linha por programa e engine: "nome engine mediana_ms rss_kb".
+static Result* baseline = NULL;
+static int baseline_count = 0;
+
+static void load_baseline(char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    char line[512];
+    while (fgets(line, sizeof line, f) != NULL) {
+        char name[256], engine[32];
+        Result r;
+        if (line[0] == '#' || sscanf(line, "%255s %31s %lf %ld", name, engine, &r.median_ms, &r.rss_kb) != 4) {
+            continue;
+        }
+        r.name = strdup(name);
+        r.engine = strdup(engine);
+        baseline = realloc(baseline, (baseline_count + 1) * sizeof(Result));
+        baseline[baseline_count++] = r;
+    }
+    fclose(f);
+}
+
+static Result* find_baseline(char* name, char* engine) {
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0 && strcmp(baseline[i].engine, engine) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static void save_baseline(char* path, Result* results, int count) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "# program engine median_ms peak_rss_kb\n");
+    if (extra_count > 0) {
+        fprintf(f, "# args:");
+        for (int i = 0; i < extra_count; i++) {
+            fprintf(f, " %s", extra_args[i]);
+        }
+        fprintf(f, "\n");
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%s %s %.3f %ld\n", results[i].name, results[i].engine, results[i].median_ms, results[i].rss_kb);
+    }
+    fclose(f);
+}
+
+// Main -----------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    int selected[ENGINE_COUNT] = { 0 };
+    int any_selected = 0;
+    int warmup = DEFAULT_WARMUP;
+    int reps = DEFAULT_REPS;
+    double threshold = DEFAULT_THRESHOLD;
+    char* baseline_path = DEFAULT_BASELINE;
+    int save = 0;
+
+    for (int i = 1; i < argc; i++) {
+        char* end;
+        if (strcmp(argv[i], "--exe") == 0 && i + 1 < argc) {
+            exe = argv[++i];
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            char* name = argv[++i];
+            int e = 0;
+            while (e < ENGINE_COUNT && strcmp(engines[e].name, name) != 0) {
+                e++;
+            }
+            if (e == ENGINE_COUNT) {
+                usage(argv[0]);
+            }
+            selected[e] = 1;
+            any_selected = 1;
+        }
+        else if (strcmp(argv[i], "--arg") == 0 && i + 1 < argc && extra_count < MAX_ARGS) {
+            extra_args[extra_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || warmup < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || reps <= 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], &end);
+            if (*end != '\0' || threshold < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--save") == 0) {
+            save = 1;
+        }
+        else if (argv[i][0] != '-') {
+            add_program(argv[i]);
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+    if (!any_selected) {
+        for (int e = 0; e < ENGINE_COUNT; e++) {
+            selected[e] = 1;
+        }
+    }
+    if (program_count == 0) {
+        add_program("primes.cm");
+        add_program("fizzbuzz.cm");
+        add_glob("in/c*.cm");
+        add_glob("bench/*.cm");
+    }
+    if (access(exe, X_OK) == -1) {
+        perror(exe);
+        return EXIT_FAILURE;
+    }
+    if (!save) {
+        load_baseline(baseline_path);
+        if (baseline_count == 0) {
+            printf("No baseline in %s; run with --save (make bench-baseline) to record one.\n\n", baseline_path);
+        }
+    }
+
+    char out_path[] = "/tmp/cminus-bench-XXXXXX";
+    int out_fd = mkstemp(out_path);
+    if (out_fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    unlink(out_path);
+
+    Result* results = malloc(program_count * ENGINE_COUNT * sizeof(Result));
+    int result_count = 0;
+    double* times = malloc(reps * sizeof(double));
+    int wrong = 0;
+    int regressed = 0;
+
+    printf("%d warmup + %d measured runs per program and engine, threshold %.0f%%\n",
+           warmup, reps, threshold);
+    printf("%-12s %-6s %10s %10s %10s %9s %11s %8s\n",
+           "program", "engine", "min ms", "median ms", "p90 ms", "peak RSS", "baseline ms", "change");
+
+    for (int p = 0; p < program_count; p++) {
+        char* name = program_name(programs[p]);
+        char path[512];
+        snprintf(path, sizeof path, "in/%s.in", name);
+        char* input = access(path, R_OK) == 0 ? strdup(path) : "/dev/null";
+        snprintf(path, sizeof path, "out2/%s.out", name);
+        size_t expected_size = 0;
+        char* expected = read_file(path, &expected_size);
+
+        for (int e = 0; e < ENGINE_COUNT; e++) {
+            if (!selected[e]) {
+                continue;
+            }
+            char* problem = NULL;
+            long rss = 0;
+            for (int i = 0; i < warmup + reps && problem == NULL; i++) {
+                Run r = run_once(programs[p], engines[e].flag, input, out_fd);
+                if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 0) {
+                    problem = "FAILED";
+                }
+                else if (expected == NULL) {
+                    problem = "NO out2/ OUTPUT";
+                }
+                else if (!same_output(out_fd, expected, expected_size)) {
+                    problem = "WRONG OUTPUT";
+                }
+                if (i >= warmup) {
+                    times[i - warmup] = r.ms;
+                    if (r.rss_kb > rss) {
+                        rss = r.rss_kb;
+                    }
+                }
+            }
+            if (problem != NULL) {
+                printf("%-12s %-6s %s\n", name, engines[e].name, problem);
+                wrong++;
+                continue;
+            }
+
+            qsort(times, reps, sizeof(double), by_ms);
+            Result res = { name, engines[e].name, percentile(times, reps, 50), rss };
+            results[result_count++] = res;
+            printf("%-12s %-6s %10.2f %10.2f %10.2f %6ld KB",
+                   name, engines[e].name, times[0], res.median_ms, percentile(times, reps, 90), rss);
+
+            Result* base = find_baseline(name, engines[e].name);
+            if (base == NULL) {
+                printf("\n");
+                continue;
+            }
+            double change = base->median_ms > 0 ? 100.0 * (res.median_ms / base->median_ms - 1) : 0;
+            printf(" %11.2f %+7.1f%%", base->median_ms, change);
+            if (res.median_ms > base->median_ms * (1 + threshold / 100) + SLACK_MS) {
+                printf("  SLOWER");
+                regressed++;
+            }
+            if (rss > base->rss_kb * (1 + threshold / 100) + SLACK_KB) {
+                printf("  RSS %+ld KB", rss - base->rss_kb);
+                regressed++;
+            }
+            printf("\n");
+        }
+        free(expected);
+    }
+    close(out_fd);
+
+    if (save) {
+        save_baseline(baseline_path, results, result_count);
+        printf("\nBaseline written to %s.\n", baseline_path);
+    }
+    if (wrong > 0 || regressed > 0) {
+        printf("\n%d failed or wrong, %d regressions.\n", wrong, regressed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
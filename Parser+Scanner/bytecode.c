@@ -0,0 +1,313 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bytecode.h"
+#include "compilation.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
+#include "tables.h"
+#include "trace.h"
+
+// Code buffer ----------------------------------------------------------------
+
+static int emit2(Bytecode* bc, OpCode op, int arg, int arg2) {
+    if (bc->size == bc->capacity) {
+        bc->capacity = bc->capacity == 0 ? 256 : 2 * bc->capacity;
+        bc->code = realloc(bc->code, bc->capacity * sizeof(Instr));
+    }
+    bc->code[bc->size].op = op;
+    bc->code[bc->size].arg = arg;
+    bc->code[bc->size].arg2 = arg2;
+    return bc->size++;
+}
+
+static int emit(Bytecode* bc, OpCode op, int arg) {
+    return emit2(bc, op, arg, 0);
+}
+
+// Ajusta o destino de um salto emitido antes de se conhecer o alvo.
+static void patch(Bytecode* bc, int at, int target) {
+    bc->code[at].arg = target;
+}
+
+// Lowering -------------------------------------------------------------------
+
+static void compile_node(Bytecode* bc, AST* ast);
+
+static void compile_bin_op(Bytecode* bc, AST* ast, OpCode op) {
+    compile_node(bc, get_child(ast, 0));
+    compile_node(bc, get_child(ast, 1));
+    emit(bc, op, 0);
+}
+
+static void compile_var_use(Bytecode* bc, AST* ast) {
+    int var_idx = get_data(ast);
+    int var_addr = get_address(vt, var_idx);
+    int var_size = get_size(vt, var_idx);
+
+    if (get_child_count(ast) == 1) {
+        // Acesso a uma posição de vetor: o índice fica no topo da pilha.
+        compile_node(bc, get_child(ast, 0));
+        emit(bc, var_size == -1 ? OP_LOADR : OP_LOADX, var_addr);
+    }
+    else if (var_size == -1) {
+        // Referência repassada adiante: a célula do parâmetro guarda a base.
+        emit(bc, OP_LOAD, var_addr);
+    }
+    else if (var_size != 0) {
+        // Vetor local usado sem índice: passagem por referência.
+        emit(bc, OP_ADDR, var_addr);
+    }
+    else {
+        emit(bc, OP_LOAD, var_addr);
+    }
+}
+
+static void compile_assign(Bytecode* bc, AST* ast) {
+    AST* lval = get_child(ast, 0);
+    int var_idx = get_data(lval);
+    int var_addr = get_address(vt, var_idx);
+
+    compile_node(bc, get_child(ast, 1));
+    if (get_child_count(lval) == 1) {
+        compile_node(bc, get_child(lval, 0));
+        emit(bc, get_size(vt, var_idx) == -1 ? OP_STORER : OP_STOREX, var_addr);
+    }
+    else {
+        emit(bc, OP_STORE, var_addr);
+    }
+}
+
+static void compile_if(Bytecode* bc, AST* ast) {
+    compile_node(bc, get_child(ast, 0));
+    int jz = emit(bc, OP_JZ, 0);
+    compile_node(bc, get_child(ast, 1));
+    if (get_child_count(ast) == 3) {
+        int jmp = emit(bc, OP_JMP, 0);
+        patch(bc, jz, bc->size);
+        compile_node(bc, get_child(ast, 2));
+        patch(bc, jmp, bc->size);
+    }
+    else {
+        patch(bc, jz, bc->size);
+    }
+}
+
+static void compile_while(Bytecode* bc, AST* ast) {
+    int test = bc->size;
+    compile_node(bc, get_child(ast, 0));
+    int jz = emit(bc, OP_JZ, 0);
+    compile_node(bc, get_child(ast, 1));
+    emit(bc, OP_JMP, test);
+    patch(bc, jz, bc->size);
+}
+
+// O destino do CALL é o índice da função na ft até o fim da compilação,
+// quando é trocado pelo endereço de entrada (ver compile_ast).
+// Com --profile a pilha sombra é mantida por quem chama, colada ao CALL: numa
+// chamada em cauda a troca do topo é a última coisa antes do salto, então
+// nenhuma amostra cai num ponto em que nenhuma das duas funções está na pilha.
+static void compile_fcall(Bytecode* bc, AST* ast, OpCode op) {
+    AST* arg_list = get_child(ast, 0);
+    for (int i = 0; i < get_child_count(arg_list); i++) {
+        compile_node(bc, get_child(arg_list, i));
+    }
+    if (profiling) {
+        emit(bc, op == OP_CALL ? OP_PROF_ENTER : OP_PROF_TAIL, get_data(ast));
+    }
+    emit(bc, op, get_data(ast));
+    if (profiling && op == OP_CALL) {
+        emit(bc, OP_PROF_LEAVE, 0);
+    }
+}
+
+static void compile_func_decl(Bytecode* bc, AST* ast) {
+    AST* func_header = get_child(ast, 0);
+    AST* func_body = get_child(ast, 1);
+    AST* param_list = get_child(func_header, 1);
+    int func_id = get_data(get_child(func_header, 0));
+
+    emit2(bc, OP_ENTER, get_frame_size(vt, get_func_scope(ft, func_id)), get_child_count(param_list));
+
+    // Os argumentos foram empilhados em ordem, então são desempilhados ao contrário.
+    // Parâmetros vetor também ocupam uma célula, que guarda o endereço base.
+    for (int i = get_child_count(param_list) - 1; i >= 0; i--) {
+        int var_idx = get_data(get_child(param_list, i));
+        emit(bc, OP_STORE, get_address(vt, var_idx));
+    }
+    compile_node(bc, get_child(func_body, 1));
+
+    // Função que termina sem return devolve 0.
+    emit(bc, OP_PUSH, 0);
+    emit(bc, OP_RET, 0);
+}
+
+static void compile_node(Bytecode* bc, AST* ast) {
+    switch(get_kind(ast)) {
+        case BLOCK_NODE:
+            for (int i = 0; i < get_child_count(ast); i++) {
+                AST* stmt = get_child(ast, i);
+                compile_node(bc, stmt);
+                if (get_kind(stmt) == FUNCTION_CALL_NODE) {
+                    emit(bc, OP_POP, 0);
+                }
+            }
+            break;
+
+        case ASSIGN_NODE:           compile_assign(bc, ast);            break;
+        case IF_NODE:               compile_if(bc, ast);                break;
+        case WHILE_NODE:            compile_while(bc, ast);             break;
+        case FUNCTION_CALL_NODE:    compile_fcall(bc, ast, OP_CALL);    break;
+        case TAIL_CALL_NODE:        compile_fcall(bc, ast, OP_TAILCALL); break;
+
+        case RETURN_NODE:
+            if (get_child_count(ast) == 0) {
+                emit(bc, OP_PUSH, 0);
+                emit(bc, OP_RET, 0);
+            }
+            else if (get_kind(get_child(ast, 0)) == TAIL_CALL_NODE) {
+                compile_node(bc, get_child(ast, 0));
+            }
+            else {
+                compile_node(bc, get_child(ast, 0));
+                emit(bc, OP_RET, 0);
+            }
+            break;
+
+        case INLINE_NODE:
+            compile_node(bc, get_child(ast, 0));
+            compile_node(bc, get_child(ast, 1));
+            break;
+
+        case INT_VAL_NODE:          emit(bc, OP_PUSH, get_data(ast));   break;
+        case VAR_USE_NODE:          compile_var_use(bc, ast);           break;
+        case INPUT_NODE:            emit(bc, OP_INPUT, 0);              break;
+
+        case OUTPUT_NODE:
+            compile_node(bc, get_child(ast, 0));
+            emit(bc, OP_OUTPUT, 0);
+            break;
+
+        case WRITE_NODE:
+            emit(bc, OP_WRITE, get_data(get_child(ast, 0)));
+            break;
+
+        case PLUS_NODE:             compile_bin_op(bc, ast, OP_ADD);    break;
+        case MINUS_NODE:            compile_bin_op(bc, ast, OP_SUB);    break;
+        case TIMES_NODE:            compile_bin_op(bc, ast, OP_MUL);    break;
+        case OVER_NODE:             compile_bin_op(bc, ast, OP_DIV);    break;
+        case SHL_NODE:              compile_bin_op(bc, ast, OP_SHL);    break;
+
+        case EQ_NODE:               compile_bin_op(bc, ast, OP_EQ);     break;
+        case NEQ_NODE:              compile_bin_op(bc, ast, OP_NEQ);    break;
+        case LT_NODE:               compile_bin_op(bc, ast, OP_LT);     break;
+        case LE_NODE:               compile_bin_op(bc, ast, OP_LE);     break;
+        case GT_NODE:               compile_bin_op(bc, ast, OP_GT);     break;
+        case GE_NODE:               compile_bin_op(bc, ast, OP_GE);     break;
+
+        default:
+            fprintf(stderr, "Cannot compile kind: %s!\n", kind2str(get_kind(ast)));
+            exit(EXIT_FAILURE);
+    }
+}
+
+Bytecode* compile_ast(AST* ast) {
+    Bytecode* bc = malloc(sizeof * bc);
+    bc->code = NULL;
+    bc->size = 0;
+    bc->capacity = 0;
+    bc->entry = NULL;
+    bc->func_count = 0;
+    bc->instrumented = stats_enabled || tracing;
+    bc->strings = st;
+
+    int main_id = lookup_func(ft, find_string(ids, "main"));
+    if (main_id == -1) {
+        io_write("Algo está errado. Main não encontrada.\n");
+        emit(bc, OP_HALT, 0);
+        return bc;
+    }
+    if (profiling) {
+        emit(bc, OP_PROF_ENTER, main_id);
+    }
+    emit(bc, OP_CALL, main_id);
+    if (profiling) {
+        emit(bc, OP_PROF_LEAVE, 0);
+    }
+    emit(bc, OP_HALT, 0);
+
+    int func_count = get_child_count(ast);
+    int* entry = malloc(func_count * sizeof(int));
+    for (int i = 0; i < func_count; i++) {
+        AST* func_decl_node = get_child(ast, i);
+        AST* func_name_node = get_child(get_child(func_decl_node, 0), 0);
+        int func_id = get_data(func_name_node);
+        entry[func_id] = bc->size;
+        compile_func_decl(bc, func_decl_node);
+    }
+
+    for (int pc = 0; pc < bc->size; pc++) {
+        if (bc->code[pc].op == OP_CALL || bc->code[pc].op == OP_TAILCALL) {
+            patch(bc, pc, entry[bc->code[pc].arg]);
+        }
+    }
+    bc->entry = entry;
+    bc->func_count = func_count;
+    return bc;
+}
+
+// Listing --------------------------------------------------------------------
+
+char* op2str(OpCode op) {
+    switch(op) {
+        case OP_HALT:   return "halt";
+        case OP_PUSH:   return "push";
+        case OP_POP:    return "pop";
+        case OP_LOAD:   return "load";
+        case OP_STORE:  return "store";
+        case OP_ADDR:   return "addr";
+        case OP_LOADX:  return "loadx";
+        case OP_STOREX: return "storex";
+        case OP_LOADR:  return "loadr";
+        case OP_STORER: return "storer";
+        case OP_ADD:    return "add";
+        case OP_SUB:    return "sub";
+        case OP_MUL:    return "mul";
+        case OP_DIV:    return "div";
+        case OP_SHL:    return "shl";
+        case OP_EQ:     return "eq";
+        case OP_NEQ:    return "neq";
+        case OP_LT:     return "lt";
+        case OP_LE:     return "le";
+        case OP_GT:     return "gt";
+        case OP_GE:     return "ge";
+        case OP_JMP:    return "jmp";
+        case OP_JZ:     return "jz";
+        case OP_CALL:   return "call";
+        case OP_TAILCALL: return "tailcall";
+        case OP_ENTER:  return "enter";
+        case OP_RET:    return "ret";
+        case OP_INPUT:  return "input";
+        case OP_OUTPUT: return "output";
+        case OP_WRITE:  return "write";
+        case OP_PROF_ENTER: return "prof_enter";
+        case OP_PROF_TAIL:  return "prof_tail";
+        case OP_PROF_LEAVE: return "prof_leave";
+        default:        return "ERROR!!";
+    }
+}
+
+void print_bytecode(Bytecode* bc) {
+    printf("Bytecode:\n");
+    for (int pc = 0; pc < bc->size; pc++) {
+        printf("%4d  %-8s %d %d\n", pc, op2str(bc->code[pc].op), bc->code[pc].arg, bc->code[pc].arg2);
+    }
+}
+
+void free_bytecode(Bytecode* bc) {
+    free(bc->code);
+    free(bc->entry);
+    free(bc);
+}
@@ -0,0 +1,78 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include "tables.h"
+
+// Linear bytecode for the stack VM (see vm.h).
+// ----------------------------------------------------------------------------
+
+// Endereços de variáveis são relativos ao registro de ativação corrente (fp).
+typedef enum {
+    OP_HALT,
+    OP_PUSH,    // push arg
+    OP_POP,     // descarta o topo (valor de uma chamada usada como comando)
+    OP_LOAD,    // push mem[fp + arg]
+    OP_STORE,   // mem[fp + arg] = pop
+    OP_ADDR,    // push fp + arg (endereço base de um vetor local)
+    OP_LOADX,   // i = pop; push mem[fp + arg + i]
+    OP_STOREX,  // i = pop; v = pop; mem[fp + arg + i] = v
+    OP_LOADR,   // i = pop; push mem[mem[fp + arg] + i] (vetor recebido por referência)
+    OP_STORER,  // i = pop; v = pop; mem[mem[fp + arg] + i] = v
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_SHL,
+    OP_EQ,
+    OP_NEQ,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_JMP,     // pc = arg
+    OP_JZ,      // if (pop == 0) pc = arg
+    OP_CALL,    // salva pc e fp; fp = topo dos registros; pc = arg
+    OP_TAILCALL,// pc = arg, reaproveitando o registro de ativação corrente
+    OP_ENTER,   // primeira instrução de cada função: reserva arg células a partir de fp
+                // e guarda a base da pilha de dados (sp - arg2, os arg2 argumentos)
+    OP_RET,     // v = pop; volta a pilha à base, push v; restaura pc e fp
+    OP_INPUT,
+    OP_OUTPUT,
+    OP_WRITE,   // imprime a string de índice arg da tabela de strings
+    OP_PROF_ENTER, // só com --profile: empilha a função arg na pilha sombra (ver profile.h)
+    OP_PROF_TAIL,  // só com --profile: a função arg toma o lugar do topo da pilha sombra
+    OP_PROF_LEAVE, // só com --profile: desempilha o topo da pilha sombra
+    OP_COUNT    // não é instrução: o número de opcodes acima
+} OpCode;
+
+typedef struct {
+    OpCode op;
+    int arg;
+    int arg2;
+} Instr;
+
+typedef struct {
+    Instr* code;
+    int size;
+    int capacity;
+    int* entry;     // endereço do ENTER de cada função, indexado pelo id na ft
+    int func_count;
+    int instrumented; // compilado com --stats ou --trace: a VM roda a cópia instrumentada
+    StrTable* strings; // literais do programa, para o WRITE
+} Bytecode;
+
+// Lowers a checked AST (the FUNC_LIST_NODE root) into bytecode.
+// Variable addresses and call targets are resolved here, so the VM never
+// looks at the tables except to print string literals, and those come from
+// the program's own table (bc->strings), not the current one of the thread.
+Bytecode* compile_ast(AST* ast);
+
+char* op2str(OpCode op);
+
+// Prints a listing of the code to stdout.
+void print_bytecode(Bytecode* bc);
+
+void free_bytecode(Bytecode* bc);
+
+#endif // BYTECODE_H
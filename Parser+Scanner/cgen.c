@@ -0,0 +1,461 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "compilation.h"
+#include "cgen.h"
+#include "tables.h"
+
+// Geração de C a partir da AST.
+//
+// Funções viram funções C com prefixo f_ e variáveis ganham o prefixo v_,
+// assim nenhum nome do programa colide com palavras reservadas ou com a libc.
+// Toda função devolve int (as void devolvem 0), como nas outras máquinas.
+// O código é compilado com -fwrapv para que o estouro de inteiros dê a volta,
+// do mesmo jeito que na VM, e a ordem de avaliação da esquerda para a direita
+// é preservada com temporários sempre que um dos lados tem efeitos.
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    FILE* out;
+    int temps;       // contador para nomes de temporários
+    int failed;
+} CGen;
+
+static void emit_expr(CGen* g, AST* ast);
+static void emit_inline(CGen* g, AST* ast);
+
+static void indent(CGen* g, int level) {
+    for (int i = 0; i < level; i++) {
+        fputs("    ", g->out);
+    }
+}
+
+static char* var_name(AST* ast) {
+    return get_name(vt, get_data(ast));
+}
+
+static int is_array(AST* var) {
+    return get_size(vt, get_data(var)) != 0;
+}
+
+// Verdadeiro se avaliar a expressão pode ter efeitos (chamada ou input).
+static int has_effects(AST* ast) {
+    NodeKind kind = get_kind(ast);
+    if (kind == FUNCTION_CALL_NODE || kind == TAIL_CALL_NODE || kind == INPUT_NODE || kind == INLINE_NODE) {
+        return 1;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (has_effects(get_child(ast, i))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Verdadeiro se a expressão lê algum elemento de vetor, que uma chamada
+// avaliada antes pode ter alterado (as escalares são locais e só mudam por
+// atribuição).
+static int reads_array(AST* ast) {
+    if (get_kind(ast) == VAR_USE_NODE && get_child_count(ast) == 1) {
+        return 1;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (reads_array(get_child(ast, i))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Verdadeiro se 'first' precisa ser calculada antes de 'then' num temporário:
+// C não fixa a ordem entre operandos nem entre argumentos.
+static int must_order(AST* first, AST* then) {
+    return has_effects(then) || (has_effects(first) && reads_array(then));
+}
+
+// Literais de string ---------------------------------------------------------
+
+// O literal já está decodificado na tabela (ver add_literal); aqui ele só é
+// reescrito como literal C.
+static void emit_string_literal(CGen* g, char* s) {
+    fputc('"', g->out);
+    for (int i = 0; s[i] != '\0'; i++) {
+        char c = s[i];
+        if (c == '\n') {
+            fputs("\\n", g->out);
+        }
+        else if (c == '"' || c == '\\') {
+            fprintf(g->out, "\\%c", c);
+        }
+        else if (c < ' ' || c > '~') {
+            fprintf(g->out, "\\%03o", (unsigned char) c);
+        }
+        else {
+            fputc(c, g->out);
+        }
+    }
+    fputc('"', g->out);
+}
+
+// Expressions ----------------------------------------------------------------
+
+static void emit_int(CGen* g, int n) {
+    if (n == -2147483647 - 1) {
+        fputs("(-2147483647 - 1)", g->out);
+    }
+    else if (n < 0) {
+        fprintf(g->out, "(%d)", n);
+    }
+    else {
+        fprintf(g->out, "%d", n);
+    }
+}
+
+static void emit_var_use(CGen* g, AST* ast) {
+    if (get_child_count(ast) == 1) {
+        fprintf(g->out, "v_%s[", var_name(ast));
+        emit_expr(g, get_child(ast, 0));
+        fputc(']', g->out);
+    }
+    else {
+        if (is_array(ast)) {
+            // As outras máquinas imprimiriam o endereço da célula.
+            fprintf(stderr, "cgen: array '%s' used as a value\n", var_name(ast));
+            g->failed = 1;
+        }
+        fprintf(g->out, "v_%s", var_name(ast));
+    }
+}
+
+static void emit_arg(CGen* g, AST* arg) {
+    if (get_kind(arg) == VAR_USE_NODE && get_child_count(arg) == 0 && is_array(arg)) {
+        fprintf(g->out, "v_%s", var_name(arg)); // passagem por referência
+    }
+    else {
+        emit_expr(g, arg);
+    }
+}
+
+// C não fixa a ordem de avaliação dos argumentos. Se algum argumento depois
+// do primeiro tem efeitos, ou lê um vetor depois de um argumento com efeitos,
+// todos são calculados antes, em ordem, numa expressão-comando do gcc.
+static void emit_fcall(CGen* g, AST* ast) {
+    AST* arg_list = get_child(ast, 0);
+    int n = get_child_count(arg_list);
+    int ordered = 0;
+    int effects = 0; // algum argumento anterior tem efeitos
+    for (int i = 0; i < n; i++) {
+        AST* arg = get_child(arg_list, i);
+        ordered |= i > 0 && (has_effects(arg) || (effects && reads_array(arg)));
+        effects |= has_effects(arg);
+    }
+    char* name = get_func_name(ft, get_data(ast));
+
+    if (!ordered) {
+        fprintf(g->out, "f_%s(", name);
+        for (int i = 0; i < n; i++) {
+            if (i > 0) {
+                fputs(", ", g->out);
+            }
+            emit_arg(g, get_child(arg_list, i));
+        }
+        fputc(')', g->out);
+        return;
+    }
+    int first = g->temps;
+    g->temps += n;
+    fputs("({ ", g->out);
+    for (int i = 0; i < n; i++) {
+        fprintf(g->out, "__auto_type t%d = ", first + i);
+        emit_arg(g, get_child(arg_list, i));
+        fputs("; ", g->out);
+    }
+    fprintf(g->out, "f_%s(", name);
+    for (int i = 0; i < n; i++) {
+        fprintf(g->out, i > 0 ? ", t%d" : "t%d", first + i);
+    }
+    fputs("); })", g->out);
+}
+
+static char* op_text(NodeKind kind) {
+    switch (kind) {
+        case PLUS_NODE:     return "+";
+        case MINUS_NODE:    return "-";
+        case TIMES_NODE:    return "*";
+        case OVER_NODE:     return "/";
+        case LT_NODE:       return "<";
+        case LE_NODE:       return "<=";
+        case GT_NODE:       return ">";
+        case GE_NODE:       return ">=";
+        case EQ_NODE:       return "==";
+        case NEQ_NODE:      return "!=";
+        default:            return NULL;
+    }
+}
+
+static void emit_bin_op(CGen* g, AST* ast) {
+    AST* l = get_child(ast, 0);
+    AST* r = get_child(ast, 1);
+    int shl = get_kind(ast) == SHL_NODE;
+    char* op = op_text(get_kind(ast));
+    if (!shl && op == NULL) {
+        fprintf(stderr, "cgen: cannot translate kind: %s!\n", kind2str(get_kind(ast)));
+        exit(EXIT_FAILURE);
+    }
+
+    // Se o lado direito tem efeitos, ou lê um vetor que o esquerdo pode
+    // alterar, o esquerdo é calculado antes.
+    int ordered = must_order(l, r) && get_kind(l) != INT_VAL_NODE;
+    int t = g->temps;
+    if (ordered) {
+        g->temps++;
+        fprintf(g->out, "({ int t%d = ", t);
+        emit_expr(g, l);
+        fputs("; ", g->out);
+    }
+    fputs(shl ? "(int) ((unsigned) " : "(", g->out);
+    if (ordered) {
+        fprintf(g->out, "t%d", t);
+    }
+    else {
+        emit_expr(g, l);
+    }
+    fprintf(g->out, " %s ", shl ? "<<" : op);
+    emit_expr(g, r);
+    fputc(')', g->out);
+    if (ordered) {
+        fputs("; })", g->out);
+    }
+}
+
+static void emit_expr(CGen* g, AST* ast) {
+    switch (get_kind(ast)) {
+        case INT_VAL_NODE:          emit_int(g, get_data(ast));     break;
+        case VAR_USE_NODE:          emit_var_use(g, ast);           break;
+        case FUNCTION_CALL_NODE:
+        case TAIL_CALL_NODE:        emit_fcall(g, ast);             break;
+        case INPUT_NODE:            fputs("cm_input()", g->out);    break;
+        case INLINE_NODE:           emit_inline(g, ast);            break;
+        default:                    emit_bin_op(g, ast);            break;
+    }
+}
+
+// Statements -------------------------------------------------------------------
+
+static void emit_stmt(CGen* g, AST* ast, int level);
+
+// Chamada expandida pelo inliner: os comandos e depois o valor, numa
+// expressão-comando do gcc.
+static void emit_inline(CGen* g, AST* ast) {
+    AST* body = get_child(ast, 0);
+    fputs("({\n", g->out);
+    for (int i = 0; i < get_child_count(body); i++) {
+        emit_stmt(g, get_child(body, i), 2);
+    }
+    indent(g, 2);
+    emit_expr(g, get_child(ast, 1));
+    fputs("; })", g->out);
+}
+
+static void emit_block(CGen* g, AST* ast, int level) {
+    fputs("{\n", g->out);
+    if (get_kind(ast) == BLOCK_NODE) {
+        for (int i = 0; i < get_child_count(ast); i++) {
+            emit_stmt(g, get_child(ast, i), level + 1);
+        }
+    }
+    else {
+        emit_stmt(g, ast, level + 1);
+    }
+    indent(g, level);
+    fputc('}', g->out);
+}
+
+static void emit_assign(CGen* g, AST* ast) {
+    AST* lval = get_child(ast, 0);
+    AST* expr = get_child(ast, 1);
+    if (get_child_count(lval) == 1 && must_order(expr, get_child(lval, 0))) {
+        // Como na VM, o valor é calculado antes do índice.
+        int t = g->temps++;
+        fprintf(g->out, "{ int t%d = ", t);
+        emit_expr(g, expr);
+        fputs("; ", g->out);
+        emit_var_use(g, lval);
+        fprintf(g->out, " = t%d; }\n", t);
+        return;
+    }
+    emit_var_use(g, lval);
+    fputs(" = ", g->out);
+    emit_expr(g, expr);
+    fputs(";\n", g->out);
+}
+
+static void emit_stmt(CGen* g, AST* ast, int level) {
+    indent(g, level);
+    switch (get_kind(ast)) {
+        case BLOCK_NODE:
+            emit_block(g, ast, level);
+            fputc('\n', g->out);
+            break;
+
+        case ASSIGN_NODE:
+            emit_assign(g, ast);
+            break;
+
+        case IF_NODE:
+            fputs("if (", g->out);
+            emit_expr(g, get_child(ast, 0));
+            fputs(") ", g->out);
+            emit_block(g, get_child(ast, 1), level);
+            if (get_child_count(ast) == 3) {
+                fputs(" else ", g->out);
+                emit_block(g, get_child(ast, 2), level);
+            }
+            fputc('\n', g->out);
+            break;
+
+        case WHILE_NODE:
+            fputs("while (", g->out);
+            emit_expr(g, get_child(ast, 0));
+            fputs(") ", g->out);
+            emit_block(g, get_child(ast, 1), level);
+            fputc('\n', g->out);
+            break;
+
+        case RETURN_NODE:
+            fputs("return ", g->out);
+            if (get_child_count(ast) == 1) {
+                emit_expr(g, get_child(ast, 0));
+            }
+            else {
+                fputc('0', g->out);
+            }
+            fputs(";\n", g->out);
+            break;
+
+        case FUNCTION_CALL_NODE:
+            emit_fcall(g, ast);
+            fputs(";\n", g->out);
+            break;
+
+        case OUTPUT_NODE:
+            fputs("printf(\"%d\", ", g->out);
+            emit_expr(g, get_child(ast, 0));
+            fputs(");\n", g->out);
+            break;
+
+        case WRITE_NODE:
+            fputs("fputs(", g->out);
+            emit_string_literal(g, get_string(st, get_data(get_child(ast, 0))));
+            fputs(", stdout);\n", g->out);
+            break;
+
+        default:
+            fprintf(stderr, "cgen: cannot translate kind: %s!\n", kind2str(get_kind(ast)));
+            exit(EXIT_FAILURE);
+    }
+}
+
+// Functions --------------------------------------------------------------------
+
+static void emit_signature(CGen* g, AST* func_decl) {
+    AST* func_header = get_child(func_decl, 0);
+    AST* param_list = get_child(func_header, 1);
+    int func_id = get_data(get_child(func_header, 0));
+
+    fprintf(g->out, "static int f_%s(", get_func_name(ft, func_id));
+    if (get_child_count(param_list) == 0) {
+        fputs("void", g->out);
+    }
+    for (int i = 0; i < get_child_count(param_list); i++) {
+        AST* param = get_child(param_list, i);
+        fprintf(g->out, "%sint %sv_%s", i > 0 ? ", " : "", is_array(param) ? "*" : "", var_name(param));
+    }
+    fputc(')', g->out);
+}
+
+static void emit_func_decl(CGen* g, AST* func_decl) {
+    AST* func_body = get_child(func_decl, 1);
+    AST* var_list = get_child(func_body, 0);
+
+    g->temps = 0;
+    emit_signature(g, func_decl);
+    fputs(" {\n", g->out);
+    // Variáveis locais começam zeradas, como a memória da VM.
+    for (int i = 0; i < get_child_count(var_list); i++) {
+        AST* var = get_child(var_list, i);
+        int size = get_size(vt, get_data(var));
+        if (size > 0) {
+            fprintf(g->out, "    int v_%s[%d] = {0};\n", var_name(var), size);
+        }
+        else {
+            fprintf(g->out, "    int v_%s = 0;\n", var_name(var));
+        }
+    }
+    AST* block = get_child(func_body, 1);
+    for (int i = 0; i < get_child_count(block); i++) {
+        emit_stmt(g, get_child(block, i), 1);
+    }
+    fputs("    return 0;\n}\n\n", g->out);
+}
+
+int emit_c(AST* ast, FILE* out) {
+    CGen g = { out, 0, 0 };
+    if (lookup_func(ft, find_string(ids, "main")) == -1) {
+        fprintf(stderr, "cgen: main not found\n");
+        return -1;
+    }
+
+    fputs("/* Generated by trab5 from a C-Minus program. */\n"
+          "#include <stdio.h>\n\n"
+          "static int cm_input(void) {\n"
+          "    int n;\n"
+          "    printf(\"input: \");\n"
+          "    if (scanf(\"%d\", &n) == 1) {\n"
+          "        return n;\n"
+          "    }\n"
+          "    printf(\"Falha ao ler entrada.\\n\");\n"
+          "    return 0;\n"
+          "}\n\n", out);
+
+    for (int i = 0; i < get_child_count(ast); i++) {
+        emit_signature(&g, get_child(ast, i));
+        fputs(";\n", out);
+    }
+    fputc('\n', out);
+    for (int i = 0; i < get_child_count(ast); i++) {
+        emit_func_decl(&g, get_child(ast, i));
+    }
+    fputs("int main(void) {\n"
+          "    f_main();\n"
+          "    return 0;\n"
+          "}\n", out);
+    return g.failed ? -1 : 0;
+}
+
+int compile_native(AST* ast, char* exe) {
+    char path[] = "/tmp/trab5_XXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if (fd == -1) {
+        perror("cgen: mkstemps");
+        return -1;
+    }
+    FILE* out = fdopen(fd, "w");
+    int status = emit_c(ast, out);
+    fclose(out);
+
+    if (status == 0) {
+        char* cc = getenv("CC");
+        char* cmd = malloc(strlen(path) + strlen(exe) + 64 + (cc ? strlen(cc) : 3));
+        sprintf(cmd, "%s -O2 -fwrapv -w -o '%s' '%s'", cc ? cc : "gcc", exe, path);
+        status = system(cmd) == 0 ? 0 : -1;
+        if (status != 0) {
+            fprintf(stderr, "cgen: '%s' failed\n", cmd);
+        }
+        free(cmd);
+    }
+    unlink(path);
+    return status;
+}
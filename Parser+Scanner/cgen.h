@@ -0,0 +1,20 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include <stdio.h>
+#include "ast.h"
+
+// Ahead-of-time backend: C source generated from the checked AST.
+// ----------------------------------------------------------------------------
+
+// Writes a standalone C translation unit equivalent to the program (the
+// FUNC_LIST_NODE root). Returns 0 on success or -1, with the reason on
+// stderr, when the program can't be expressed in C (e.g. an array used as
+// a number).
+int emit_c(AST* ast, FILE* out);
+
+// Emits the C code to a temporary file and compiles it into the executable
+// 'exe' with gcc -O2 (or $CC, if set). Returns 0 on success.
+int compile_native(AST* ast, char* exe);
+
+#endif // CGEN_H
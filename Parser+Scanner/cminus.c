@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cminus.h"
+#include "bytecode.h"
+#include "compilation.h"
+#include "optimizer.h"
+#include "vm.h"
+
+// O programa guarda a compilação inteira (tabelas e AST) junto com o
+// bytecode; depois de compilado nada disso é alterado, então as execuções
+// podem compartilhá-lo sem travas.
+struct cminus_program {
+    Compilation* compilation;
+    Bytecode* bc;
+};
+
+struct cminus_context {
+    const CminusProgram* program;
+    VmMachine* machine;
+};
+
+// Compilação -----------------------------------------------------------------
+
+CminusProgram* cminus_compile(const char* source, size_t size, int opt_level,
+                              char* error, size_t error_size) {
+    // O scanner lê direto do buffer, que precisa de dois '\0' no fim e ser gravável.
+    char* buf = malloc(size + 2);
+    if (buf == NULL) {
+        snprintf(error, error_size, "Out of memory!");
+        return NULL;
+    }
+    memcpy(buf, source, size);
+    buf[size] = '\0';
+    buf[size + 1] = '\0';
+
+    Compilation* c = create_compilation();
+    int status = parse_program(c, buf, size + 2, NULL);
+    free(buf);
+    if (status == 0 && lookup_func(c->ft, find_string(c->ids, "main")) == -1) {
+        compile_error(c, "no function 'main' to run");
+        status = 1;
+    }
+    if (status != 0) {
+        snprintf(error, error_size, "%s", c->error);
+        free_compilation(c);
+        return NULL;
+    }
+
+    optimize(c->root, opt_level, DEFAULT_INLINE_BUDGET, NULL);
+    CminusProgram* program = malloc(sizeof * program);
+    program->compilation = c;
+    program->bc = compile_ast(c->root);
+    return program;
+}
+
+void cminus_free_program(CminusProgram* program) {
+    free_bytecode(program->bc);
+    free_compilation(program->compilation);
+    free(program);
+}
+
+// Execução -------------------------------------------------------------------
+
+// E/S padrão: stdio, que já trava cada FILE, então contextos em threads
+// diferentes podem usá-la ao mesmo tempo (só a ordem das linhas é que fica
+// por conta do escalonador).
+static int stdin_input(void* user, int* value) {
+    (void) user;
+    return scanf("%d", value) == 1 ? 0 : -1;
+}
+
+static void stdout_output(void* user, int value) {
+    (void) user;
+    printf("%d", value);
+}
+
+static void stdout_write(void* user, const char* text) {
+    (void) user;
+    fputs(text, stdout);
+}
+
+CminusContext* cminus_create_context(const CminusProgram* program, const CminusIO* io) {
+    CminusIO with_defaults = { NULL, NULL, NULL, NULL };
+    if (io != NULL) {
+        with_defaults = *io;
+    }
+    if (with_defaults.input == NULL) {
+        with_defaults.input = stdin_input;
+    }
+    if (with_defaults.output == NULL) {
+        with_defaults.output = stdout_output;
+    }
+    if (with_defaults.write == NULL) {
+        with_defaults.write = stdout_write;
+    }
+
+    VmMachine* machine = create_machine(with_defaults);
+    if (machine == NULL) {
+        return NULL;
+    }
+    CminusContext* context = malloc(sizeof * context);
+    if (context == NULL) {
+        free_machine(machine);
+        return NULL;
+    }
+    context->program = program;
+    context->machine = machine;
+    return context;
+}
+
+int cminus_run(CminusContext* context) {
+    return run_machine(context->program->bc, context->machine);
+}
+
+const char* cminus_error(const CminusContext* context) {
+    return context->machine->error;
+}
+
+void cminus_free_context(CminusContext* context) {
+    free_machine(context->machine);
+    free(context);
+}
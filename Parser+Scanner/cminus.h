@@ -0,0 +1,63 @@
+#ifndef CMINUS_H
+#define CMINUS_H
+
+#include <stddef.h>
+
+// libcminus: C-minus programs embedded in a C or C++ host.
+// ----------------------------------------------------------------------------
+
+// A program is compiled once (scanner, parser, checks, the -O passes and
+// bytecode) into an immutable CminusProgram. Each run needs a CminusContext,
+// which owns the VM's data stack, call stack and memory plus the I/O
+// callbacks. A program can be shared by any number of contexts, in any
+// number of threads; a context runs in one thread at a time. Compiling is
+// thread-safe too.
+// The VM checks the data stack and every array access, and division by zero:
+// a faulty program ends its run with an error, never the host.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cminus_program CminusProgram;
+typedef struct cminus_context CminusContext;
+
+// Program I/O. Every callback gets 'user' back; a NULL callback means the
+// default one, on stdin/stdout.
+typedef struct {
+    // input(): stores the next value in *value and returns 0, or returns
+    // nonzero when there is none (the run then fails).
+    int (*input)(void* user, int* value);
+    // output(n): just the number, nothing around it.
+    void (*output)(void* user, int value);
+    // write("..."): the literal with its escape sequences already decoded.
+    void (*write)(void* user, const char* text);
+    void* user;
+} CminusIO;
+
+// Compiles the size bytes at source (no '\0' needed), optimized as with
+// trab5 -O<opt_level>. Returns NULL on error, with the message trab5 would
+// print in error (at most error_size bytes, '\0' included).
+CminusProgram* cminus_compile(const char* source, size_t size, int opt_level,
+                              char* error, size_t error_size);
+
+// The program must outlive every context created for it.
+void cminus_free_program(CminusProgram* program);
+
+// io may be NULL (all defaults). Returns NULL if there is no memory for the VM.
+CminusContext* cminus_create_context(const CminusProgram* program, const CminusIO* io);
+
+// Runs the program from main(), with zeroed memory, as many times as wanted.
+// Returns 0, or -1 after a runtime error (see cminus_error).
+int cminus_run(CminusContext* context);
+
+// The last runtime error of the context, or "" if its last run succeeded.
+const char* cminus_error(const CminusContext* context);
+
+void cminus_free_context(CminusContext* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMINUS_H
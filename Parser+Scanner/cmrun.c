@@ -0,0 +1,205 @@
+// Exemplo de uso da libcminus, que também serve de teste: compila o programa
+// uma vez e o executa várias vezes em várias threads, cada uma com o seu
+// contexto, todas lendo a mesma entrada. Todas as execuções têm que produzir
+// a mesma saída, que é impressa uma vez só.
+// A E/S imita a do trab5 sem --batch (o prompt "input: " e a mensagem quando
+// a entrada acaba), para que a saída seja comparável com a dele.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cminus.h"
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static void append(Buffer* b, const char* s, size_t n) {
+    if (b->size + n > b->capacity) {
+        b->capacity = 2 * (b->size + n);
+        b->data = realloc(b->data, b->capacity);
+    }
+    memcpy(b->data + b->size, s, n);
+    b->size += n;
+}
+
+// A entrada, lida de stdin uma vez só e compartilhada (só leitura) por todos.
+static int* values = NULL;
+static int value_count = 0;
+
+static CminusProgram* program;
+static Buffer expected = { NULL, 0, 0 };
+static int runs = 1;
+
+typedef struct {
+    Buffer out;
+    int next; // próximo valor da entrada
+    int failures;
+} Run;
+
+static int on_input(void* user, int* value) {
+    Run* r = user;
+    append(&r->out, "input: ", 7);
+    if (r->next < value_count) {
+        *value = values[r->next++];
+    }
+    else {
+        const char* msg = "Falha ao ler entrada.\n";
+        append(&r->out, msg, strlen(msg));
+        *value = 0;
+    }
+    return 0;
+}
+
+static void on_output(void* user, int value) {
+    char digits[16];
+    int n = snprintf(digits, sizeof digits, "%d", value);
+    append(&((Run*) user)->out, digits, n);
+}
+
+static void on_write(void* user, const char* text) {
+    append(&((Run*) user)->out, text, strlen(text));
+}
+
+// Uma execução completa no contexto; devolve 0 ou -1 (erro de execução).
+static int run_once(CminusContext* context, Run* r) {
+    r->out.size = 0;
+    r->next = 0;
+    return cminus_run(context);
+}
+
+static void* worker(void* arg) {
+    Run* r = arg;
+    CminusIO io = { on_input, on_output, on_write, r };
+    CminusContext* context = cminus_create_context(program, &io);
+    if (context == NULL) {
+        r->failures = runs;
+        return NULL;
+    }
+    for (int i = 0; i < runs; i++) {
+        if (run_once(context, r) != 0 || r->out.size != expected.size
+            || memcmp(r->out.data, expected.data, expected.size) != 0) {
+            r->failures++;
+        }
+    }
+    cminus_free_context(context);
+    return NULL;
+}
+
+static char* read_file(char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    Buffer b = { NULL, 0, 0 };
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, f)) > 0) {
+        append(&b, chunk, n);
+    }
+    fclose(f);
+    *size = b.size;
+    return b.data;
+}
+
+static void usage(char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [-O0|-O1] [-t THREADS] [-n RUNS] program.cm\n"
+            "Compiles program.cm once with libcminus and runs it RUNS times (default 1)\n"
+            "in each of THREADS threads (default 1), with the integers on stdin as\n"
+            "input. Prints the output if every run produced the same output.\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    int opt_level = 0;
+    int threads = 1;
+    char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        char* end = "";
+        if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0) {
+            opt_level = argv[i][2] - '0';
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], &end, 10);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            runs = strtol(argv[++i], &end, 10);
+        }
+        else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+        }
+        if (*end != '\0' || threads < 1 || runs < 1) {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+
+    int capacity = 1024;
+    values = malloc(capacity * sizeof(int));
+    while (scanf("%d", &values[value_count]) == 1) {
+        if (++value_count == capacity) {
+            capacity *= 2;
+            values = realloc(values, capacity * sizeof(int));
+        }
+    }
+
+    size_t size;
+    char* source = read_file(path, &size);
+    char error[512];
+    program = cminus_compile(source, size, opt_level, error, sizeof error);
+    free(source);
+    if (program == NULL) {
+        printf("%s\n", error);
+        return EXIT_FAILURE;
+    }
+
+    // A primeira execução dá a saída de referência.
+    Run first = { { NULL, 0, 0 }, 0, 0 };
+    CminusIO io = { on_input, on_output, on_write, &first };
+    CminusContext* context = cminus_create_context(program, &io);
+    if (context == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    int status = run_once(context, &first);
+    fwrite(first.out.data, 1, first.out.size, stdout);
+    if (status != 0) {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", cminus_error(context));
+        return EXIT_FAILURE;
+    }
+    expected = first.out;
+
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    Run* work = calloc(threads, sizeof(Run));
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&ids[t], NULL, worker, &work[t]);
+    }
+    int failures = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        failures += work[t].failures;
+        free(work[t].out.data);
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d of %d runs differ from the first one\n", failures, threads * runs);
+    }
+
+    free(work);
+    free(ids);
+    free(expected.data);
+    free(values);
+    cminus_free_context(context);
+    cminus_free_program(program);
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compilation.h"
+#include "parser.h"
+
+// Funções do scanner (scanner.l), que esconde a API do flex.
+int start_scanner(Compilation* c, char* buf, size_t size, FILE* in);
+void stop_scanner(Compilation* c);
+
+_Thread_local StrTable* st;
+_Thread_local StrTable* ids;
+_Thread_local VarTable* vt;
+_Thread_local FuncTable* ft;
+
+Compilation* create_compilation(void) {
+    Compilation* c = malloc(sizeof * c);
+    c->st = create_str_table();
+    c->ids = create_str_table();
+    c->vt = create_var_table(c->ids);
+    c->ft = create_func_table(c->ids);
+    c->arena = create_arena();
+    c->root = NULL;
+    c->func_type = VOID_TYPE;
+    c->scope = 0;
+    c->arity = 0;
+    c->scanner = NULL;
+    c->error[0] = '\0';
+    return c;
+}
+
+void use_compilation(Compilation* c) {
+    st = c->st;
+    ids = c->ids;
+    vt = c->vt;
+    ft = c->ft;
+    use_arena(c->arena);
+}
+
+void compile_error(Compilation* c, const char* fmt, ...) {
+    if (c->error[0] != '\0') {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(c->error, sizeof c->error, fmt, ap);
+    va_end(ap);
+}
+
+int parse_program(Compilation* c, char* buf, size_t size, FILE* in) {
+    use_compilation(c);
+    if (!start_scanner(c, buf, size, in)) {
+        compile_error(c, "Out of memory while starting the scanner!");
+        return 1;
+    }
+    int status = yyparse(c);
+    stop_scanner(c);
+    // Um erro semântico na última redução não chega a interromper o parser.
+    return status != 0 || c->error[0] != '\0';
+}
+
+// O scanner lê direto da página mapeada (yy_scan_buffer), que precisa
+// terminar com dois '\0' e ser gravável: o flex escreve temporariamente no
+// fim de cada token. A região é reservada com duas células a mais, anônimas
+// (zeradas), e o arquivo é mapeado por cima com MAP_PRIVATE, de modo que as
+// escritas do scanner nunca chegam ao arquivo e nada é copiado para um buffer.
+// Os tokens são copiados para as tabelas, então o mapeamento só vive durante
+// o parse.
+int parse_file(Compilation* c, char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        compile_error(c, "%s: %s", path, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    size_t size = sb.st_size;
+    size_t length = size + 2;
+    char* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        compile_error(c, "mmap: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (size > 0 && mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        compile_error(c, "%s: %s", path, strerror(errno));
+        munmap(base, length);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    int status = parse_program(c, base, length, NULL);
+    munmap(base, length);
+    return status;
+}
+
+void free_compilation(Compilation* c) {
+    free_str_table(c->st);
+    free_var_table(c->vt);
+    free_func_table(c->ft);
+    free_str_table(c->ids);
+    free_arena(c->arena);
+    if (ft == c->ft) {
+        st = NULL;
+        ids = NULL;
+        vt = NULL;
+        ft = NULL;
+    }
+    free(c);
+}
@@ -0,0 +1,64 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "tables.h"
+#include "types.h"
+
+// Per-compilation context.
+// ----------------------------------------------------------------------------
+
+// Everything the scanner and the parser work on: the tables, the AST and its
+// arena, the parser's counters and the flex scanner itself. Compilations share
+// nothing, so different threads can parse different programs at the same time.
+// Errors don't end the process: the first one is kept in 'error' and the parse
+// stops at the next token.
+
+#define COMPILE_ERROR_SIZE 512
+
+typedef struct {
+    StrTable* st;   // string literals
+    StrTable* ids;  // identifiers interned by the scanner; ID tokens carry an index here
+    VarTable* vt;
+    FuncTable* ft;
+    Arena* arena;   // holds every node of root
+    AST* root;      // FUNC_LIST_NODE, once the parse succeeds
+
+    Type func_type; // return type of the function being declared
+    int scope;      // scope of the variables added to vt; one per function
+    int arity;      // parameters seen so far; reset when the function is added to ft
+    void* scanner;  // flex state (yyscan_t), only during the parse
+
+    char error[COMPILE_ERROR_SIZE]; // the first error, as it is reported; empty if none
+} Compilation;
+
+Compilation* create_compilation(void);
+
+// Parses and checks a program, which is also made current (see use_compilation).
+// buf holds size bytes, the last two '\0' (as yy_scan_buffer requires), and must
+// be writable; if buf is NULL the program is read from in instead.
+// Returns 0 on success; otherwise c->error has the first error found.
+int parse_program(Compilation* c, char* buf, size_t size, FILE* in);
+
+// Same, reading the program from the file at path. Returns -1, with the
+// reason in c->error, if the file can't be read.
+int parse_file(Compilation* c, char* path);
+
+// Records an error found while parsing; only the first one is kept.
+void compile_error(Compilation* c, const char* fmt, ...);
+
+// Makes c the program the back end of the calling thread works on: the
+// optimizer, the bytecode compiler and the engines read the tables below, and
+// new AST nodes go to c's arena.
+void use_compilation(Compilation* c);
+
+void free_compilation(Compilation* c);
+
+// The tables of the current program of each thread (see use_compilation).
+extern _Thread_local StrTable* st;
+extern _Thread_local StrTable* ids;
+extern _Thread_local VarTable* vt;
+extern _Thread_local FuncTable* ft;
+
+#endif // COMPILATION_H
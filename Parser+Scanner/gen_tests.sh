@@ -1,14 +1,17 @@
 #!/bin/bash
+# Regenera as saídas esperadas em out2/ a partir do trab5 atual.
+# Programas que usam input() leem de in/<nome>.in, se existir.
 
-YEAR=$(pwd | grep -o '20..-.')
-DATA=/home/matheus/Documentos/Matheus/UFES/8p/compiladores/trabCminus/Parser+Scanner
-IN=$DATA/in
-OUT=$DATA/out2
+cd "$(dirname "$0")"
 
-EXE=./parser
+IN=in
+OUT=out2
 
-for infile in `ls $IN/*.cm`; do
-    base=$(basename $infile)
-    outfile=$OUT/${base/.cm/.out}
-    $EXE < $infile > $outfile
+EXE=./trab5
+
+for infile in $IN/*.cm; do
+    base=$(basename $infile .cm)
+    input=$IN/$base.in
+    [ -f $input ] || input=/dev/null
+    $EXE $infile --input $input > $OUT/$base.out 2>/dev/null
 done
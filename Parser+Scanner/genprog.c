@@ -0,0 +1,158 @@
+// Gerador de programas C-minus sintéticos, para medir o front end com
+// entradas grandes (scaling.sh).
+// O programa gerado é válido e termina: cada função só chama a anterior, com
+// um argumento que diminui a cada chamada, e main imprime um checksum.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned seed = 1;
+
+// Gerador congruencial: a saída só depende dos argumentos.
+static int next(int n) {
+    seed = seed * 1103515245u + 12345u;
+    return (int) ((seed >> 16) % (unsigned) n);
+}
+
+static void indent(int depth) {
+    for (int i = 0; i < depth; i++) {
+        fputs("    ", stdout);
+    }
+}
+
+// Uma expressão pequena com os parâmetros e as variáveis locais da função.
+static void expr(int f) {
+    static const char* ops[] = { "+", "-" };
+    switch (next(4)) {
+        case 0:  printf("x%d + a * %d", f, 1 + next(9));                                 break;
+        case 1:  printf("(y%d %s b) / %d", f, ops[next(2)], 2 + next(7));                break;
+        case 2:  printf("v%d[%d] - x%d / 2", f, next(4), f);                             break;
+        default: printf("a %s y%d %s %d", ops[next(2)], f, ops[next(2)], next(100));     break;
+    }
+}
+
+// Cada função chama a anterior uma vez só (no máximo três vezes, dentro de um
+// laço), senão o número de chamadas cresceria exponencialmente.
+static int called = 0;
+
+// Escreve um comando e devolve quantos comandos escreveu (os aninhados contam).
+// Dentro de um laço o contador i não é atribuído nem há outro laço.
+static int stmt(int f, int depth, int budget, int in_loop) {
+    int kind = budget >= 3 && depth < 4 ? next(10) : next(5);
+    if ((kind == 9 && called) || (kind == 4 && in_loop)) {
+        kind = 0;
+    }
+    if ((kind == 7 || kind == 8) && in_loop) {
+        kind = 6;
+    }
+    indent(depth);
+    if (kind < 5) {
+        switch (kind) {
+            case 0:  printf("x%d = ", f);                 break;
+            case 1:  printf("y%d = ", f);                 break;
+            case 2:  printf("v%d[%d] = ", f, next(4));    break;
+            case 3:  printf("v%d[i%d] = ", f, f);         break;
+            default: printf("i%d = ", f);                 break;
+        }
+        if (kind == 4) {
+            printf("%d;\n", next(4));
+        }
+        else {
+            expr(f);
+            printf(";\n");
+        }
+        return 1;
+    }
+    if (kind < 7) {
+        printf("if (x%d < y%d) {\n", f, f);
+        int n = 1 + stmt(f, depth + 1, (budget - 1) / 2, in_loop);
+        indent(depth);
+        printf("}\n");
+        if (kind == 6) {
+            indent(depth);
+            printf("else {\n");
+            n += stmt(f, depth + 1, (budget - n) / 2, in_loop);
+            indent(depth);
+            printf("}\n");
+        }
+        return n;
+    }
+    if (kind < 9) {
+        // Laço limitado: i só cresce e v[i] é um índice válido.
+        printf("i%d = 0;\n", f);
+        indent(depth);
+        printf("while (i%d < 3) {\n", f);
+        int n = 3 + stmt(f, depth + 1, (budget - 3) / 2, 1);
+        indent(depth + 1);
+        printf("i%d = i%d + 1;\n", f, f);
+        indent(depth);
+        printf("}\n");
+        return n;
+    }
+    called = 1;
+    if (f == 0) {
+        printf("output(x%d);\n", f);
+        return 1;
+    }
+    printf("if (a > 0) {\n");
+    indent(depth + 1);
+    printf("y%d = f%d(a - 1, x%d, v%d);\n", f, f - 1, f, f);
+    indent(depth);
+    printf("}\n");
+    return 2;
+}
+
+static void function(int f, int stmts) {
+    printf("int f%d(int a, int b, int w[]) {\n", f);
+    printf("    int x%d;\n    int y%d;\n    int i%d;\n    int v%d[4];\n", f, f, f, f);
+    printf("    x%d = a;\n    y%d = b;\n    i%d = 0;\n", f, f, f);
+    printf("    v%d[0] = w[0];\n    v%d[1] = 1;\n    v%d[2] = 2;\n    v%d[3] = 3;\n", f, f, f, f);
+    int n = 9;
+    called = 0;
+    while (n < stmts) {
+        n += stmt(f, 1, stmts - n, 0);
+    }
+    printf("    return x%d + y%d;\n}\n\n", f, f);
+}
+
+int main(int argc, char* argv[]) {
+    long funcs = 100;
+    long stmts = 10000;
+    for (int i = 1; i < argc; i++) {
+        char* end;
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            funcs = strtol(argv[++i], &end, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            stmts = strtol(argv[++i], &end, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], &end, 10);
+        }
+        else {
+            end = argv[i];
+        }
+        if (*end != '\0' || funcs < 1 || stmts < 0) {
+            fprintf(stderr,
+                    "Usage: %s [-f FUNCS] [-s STATEMENTS] [--seed N]\n"
+                    "Writes a valid C-minus program with FUNCS functions (default 100) and\n"
+                    "about STATEMENTS statements (default 10000) in total to stdout.\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (long f = 0; f < funcs; f++) {
+        // Reparte os comandos por igual; cada função tem pelo menos o prólogo.
+        long share = stmts / funcs + (f < stmts % funcs ? 1 : 0);
+        function(f, share);
+    }
+    printf("void main(void) {\n");
+    printf("    int v[4];\n");
+    printf("    v[0] = 7;\n");
+    printf("    output(f%ld(3, 5, v));\n", funcs - 1);
+    printf("    write(\"\\n\");\n");
+    printf("}\n");
+    return EXIT_SUCCESS;
+}
@@ -1,21 +1,26 @@
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "compilation.h"
 #include "interpreter.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
 #include "tables.h"
+#include "trace.h"
+#include "vm.h"
 
 // ----------------------------------------------------------------------------
 
-extern StrTable *st;
-extern VarTable *vt;
-extern FuncTable *ft;
-
 // ----------------------------------------------------------------------------
 
 // Data stack -----------------------------------------------------------------
 
-#define STACK_SIZE 1000
+#define STACK_SIZE (1 << 20)
 
 int stack[STACK_SIZE];
 int sp; // stack pointer
@@ -49,9 +54,14 @@ void print_stack() {
 
 // Variables memory -----------------------------------------------------------
 
-#define MEM_SIZE 300
+// A memória é uma pilha de registros de ativação: fp aponta para o início do
+// registro da função em execução e frame_top para a primeira célula livre.
+
+#define MEM_SIZE (1 << 20)
 
 int mem[MEM_SIZE];
+int fp;
+int frame_top;
 
 void store(int addr, int val) {
     mem[addr] = val;
@@ -65,11 +75,13 @@ void init_mem() {
     for (int addr = 0; addr < MEM_SIZE; addr++) {
         mem[addr] = 0;
     }
+    fp = 0;
+    frame_top = 0;
 }
 
 void print_mem(){
-    printf("*** MEM: ");
-    for (int addr = 0; addr < MEM_SIZE; addr++) {
+    printf("*** MEM (fp = %d): ", fp);
+    for (int addr = 0; addr < frame_top; addr++) {
         printf("%d ", mem[addr]);
     }
     printf("\n");
@@ -77,18 +89,15 @@ void print_mem(){
 
 // ----------------------------------------------------------------------------
 
-// #define TRACE
-#ifdef TRACE
-#define trace(msg) printf("TRACE: %s\n", msg)
-#else
-#define trace(msg)
-#endif
-
 #define MAX_STR_SIZE 128
 //static char str_buf[MAX_STR_SIZE];
 #define clear_str_buf() str_buf[0] = '\0'
 
-void rec_run_ast(AST* ast);
+// Cada nó guarda o handler escolhido por link_ast, então a execução salta
+// direto de um nó para o próximo, sem passar por um switch central.
+static inline void rec_run_ast(AST* ast) {
+    get_handler(ast)(ast);
+}
 
 #define run_bin_op()                \
     AST* lexpr = get_child(ast, 0); \
@@ -96,123 +105,102 @@ void rec_run_ast(AST* ast);
     rec_run_ast(lexpr);             \
     rec_run_ast(rexpr)
 
-void plus_int(AST* ast) {
-    run_bin_op();
-    int r = pop();
-    int l = pop();
-    push(l + r);
-}
-
-void run_other_arith(AST* ast, int (*int_op)(int,int)) {
-    run_bin_op();
-    int r = pop();
-    int l = pop();
-    push(int_op(l,r));
-}
-
-int int_minus(int l, int r) {
-    return l - r;
-}
-
-int int_over(int l, int r) {
-    return l / r;
-}
-
-int int_times(int l, int r) {
-    return l * r;
-}
-
-void run_cmp(AST* ast, int (*int_cmp)(int,int)) {
-    run_bin_op();
-    int r = pop();
-    int l = pop();
-    push(int_cmp(l, r));
-}
-
-int int_eq(int l, int r) {
-    return l == r;
-}
-
-int int_neq(int l, int r){
-    return l != r;
-}
-
-int int_lt(int l, int r) {
-    return l < r;
-}
-
-int int_le(int l, int r){
-    return l <= r;
-}
-
-int int_ge(int l, int r){
-    return l >= r;
-}
-
-int int_gt(int l, int r){
-    return l > r;
-}
+// Gera o handler genérico do operador e a versão especializada para quando
+// o operando da direita é uma constante (não precisa empilhá-la).
+#define DEF_BIN_OP(name, expr)                                  \
+void run_##name(AST* ast) {                                     \
+    run_bin_op();                                               \
+    int r = pop();                                              \
+    int l = pop();                                              \
+    push(expr);                                                 \
+}                                                               \
+void run_##name##_const(AST* ast) {                             \
+    rec_run_ast(get_child(ast, 0));                             \
+    int l = stack[sp];                                          \
+    int r = get_data(get_child(ast, 1));                        \
+    stack[sp] = (expr);                                         \
+}
+
+/* Arithmetic. */
+DEF_BIN_OP(plus,  l + r)
+DEF_BIN_OP(minus, l - r)
+DEF_BIN_OP(times, l * r)
+DEF_BIN_OP(over,  l / r)
+DEF_BIN_OP(shl,   (int) ((unsigned) l << r))
+
+/* Comparisons. */
+DEF_BIN_OP(eq,  l == r)
+DEF_BIN_OP(neq, l != r)
+DEF_BIN_OP(lt,  l < r)
+DEF_BIN_OP(le,  l <= r)
+DEF_BIN_OP(gt,  l > r)
+DEF_BIN_OP(ge,  l >= r)
 
 // ----------------------------------------------------------------------------
 
-int get_offset(AST* ast){
-    AST* child = get_child(ast, 0);
-    int offset;
+// Endereço absoluto da variável no registro de ativação corrente.
+// O deslocamento foi gravado no nó por resolve_ast.
+#define frame_addr(ast) (fp + get_slot(ast))
 
-    if(get_kind(child) == INT_VAL_NODE){
-        offset = get_data(child);
-    }
-    else if(get_kind(child) == VAR_USE_NODE){
-        int var_idx = get_data(child);
-        int var_addr = get_address(vt, var_idx);
-        offset = load(var_addr);
-    }
-    else{
-        printf("Nó de acesso não é nem inteiro nem variável. Algo está errado.\n");
-        exit(EXIT_FAILURE);
-    }
+// Base de um vetor: o vetor local fica no próprio registro, já o parâmetro
+// vetor tem uma célula com o endereço base do vetor do chamador.
+#define local_base(ast) frame_addr(ast)
+#define ref_base(ast)   load(frame_addr(ast))
 
-    return offset;
-}
+// O índice de um vetor é sempre um número ou uma variável simples (ver parser.y),
+// por isso cada caso tem seu próprio handler.
 
-void run_assign(AST* ast) {
-    trace("assign");
-    AST* rexpr = get_child(ast, 1);
-    rec_run_ast(rexpr);
-    
-    AST* lval = get_child(ast, 0); 
-    int var_idx = get_data(lval);
-    int var_addr = get_address(vt, var_idx);
-
-    if(get_child_count(lval) == 1){
-        int offset = get_offset(lval);
-        store(var_addr + offset, pop());
-    }
-    else{
-        store(var_addr, pop());
-    }
+static inline int const_offset(AST* ast) {
+    return get_data(get_child(ast, 0));
 }
 
-void run_eq(AST* ast) {
-    trace("eq");
-    run_cmp(ast, int_eq);
+static inline int var_offset(AST* ast) {
+    return load(frame_addr(get_child(ast, 0)));
 }
 
-void run_neq(AST* ast){
-    trace("neq");
-    run_cmp(ast, int_neq);
-}
+void run_assign(AST* ast) {
+    rec_run_ast(get_child(ast, 1));
+    store(frame_addr(get_child(ast, 0)), pop());
+}
+
+// Gera leitura e escrita de posição de vetor com índice constante ou variável.
+#define DEF_INDEXED(name, base)                                         \
+void run_var_use_##name##_const(AST* ast) {                            \
+    push(load(base(ast) + const_offset(ast)));                          \
+}                                                                       \
+void run_var_use_##name##_var(AST* ast) {                              \
+    push(load(base(ast) + var_offset(ast)));                            \
+}                                                                       \
+void run_assign_##name##_const(AST* ast) {                             \
+    rec_run_ast(get_child(ast, 1));                                     \
+    AST* lval = get_child(ast, 0);                                      \
+    store(base(lval) + const_offset(lval), pop());                      \
+}                                                                       \
+void run_assign_##name##_var(AST* ast) {                               \
+    rec_run_ast(get_child(ast, 1));                                     \
+    AST* lval = get_child(ast, 0);                                      \
+    store(base(lval) + var_offset(lval), pop());                        \
+}
+
+DEF_INDEXED(idx, local_base)
+DEF_INDEXED(ref_idx, ref_base)
+
+// Ligado por run_return: a função corrente está saindo, então blocos e laços
+// param imediatamente até a execução voltar para run_function.
+static int returning = 0;
+static int return_value = 0;
 
 void run_block(AST* ast) {
-    trace("block");
     int size = get_child_count(ast);
     for (int i = 0; i < size; i++) {
         rec_run_ast(get_child(ast, i));
+        if (returning) {
+            return;
+        }
     }
 }
 
 void run_if(AST* ast) {
-    trace("if");
     rec_run_ast(get_child(ast, 0));
     int test = pop();
     if (test == 1) {
@@ -223,189 +211,171 @@ void run_if(AST* ast) {
 }
 
 void run_int_val(AST* ast) {
-    trace("int_val");
     push(get_data(ast));
 }
 
-void run_lt(AST* ast) {
-    trace("lt");
-    run_cmp(ast, int_lt);
-}
-
-void run_le(AST* ast){
-    trace("le");
-    run_cmp(ast, int_le);
-}
-
-void run_ge(AST* ast){
-    trace("ge");
-    run_cmp(ast, int_ge);
-}
-
-void run_gt(AST* ast){
-    trace("gt");
-    run_cmp(ast, int_gt);
-}
-
-void run_minus(AST* ast) {
-    trace("minus");
-    run_other_arith(ast, int_minus);
-}
-
-void run_over(AST* ast) {
-    trace("over");
-    run_other_arith(ast, int_over);
-}
-
-void run_plus(AST* ast) {
-    trace("plus");
-    plus_int(ast);
-}
-
 void run_program(AST* ast) {
-    trace("program");
     rec_run_ast(get_child(ast, 0)); // run var_list
     rec_run_ast(get_child(ast, 1)); // run block
 }
 
 void run_input(AST* ast) {
-    trace("input");
-    int n;
-    printf("input: ");
-    if(scanf("%d", &n) == 1){
-        push(n);
-    }
-    else{
-        printf("Falha ao ler entrada.\n");
-        push(0);
-    }
+    push(io_input());
 }
 
 void run_while(AST* ast) {
-    trace("while");
     rec_run_ast(get_child(ast, 0)); // Run test.
     int loop = pop();
     while (loop) {
         rec_run_ast(get_child(ast, 1)); // Run block.
+        if (returning) {
+            return;
+        }
         rec_run_ast(get_child(ast, 0)); // Run test.
         loop = pop();
     }
 }
 
 void run_str_val(AST* ast) {
-    trace("str_val");
     push(get_data(ast));
 }
 
-void run_times(AST* ast) {
-    trace("times");
-    run_other_arith(ast, int_times);
-}
-
 void run_var_decl(AST* ast) {
-    trace("var_decl");
     // Esse trecho de código só roda quando um nó é filho de param_list.
-    // Obtém o id do parâmetro na tabela vt, depois obtém seu endereço de memória. Depois, pega o que está na pilha e joga para esse endereço.
-    // Checa se o size é -1. Se é, é um vetor e não deve haver passagem por cópia, mas sim modificação do endereço.
-    int var_idx = get_data(ast);
-    int var_addr = get_address(vt, var_idx);
-    int var_size = get_size(vt, var_idx);
-
-    if(var_size == -1){
-        set_address(vt, var_idx, pop());
-    }
-    else{
-        store(var_addr, pop());
-    }
+    // Pega o que está na pilha e joga para a célula do parâmetro no registro de ativação.
+    // Se o parâmetro é um vetor (size -1), o valor é o endereço base do vetor do chamador.
+    store(frame_addr(ast), pop());
 }
 
 void run_var_list(AST* ast) {
-    trace("var_list");
     // Nada precisa ser feito aqui.
 }
 
 void run_var_use(AST* ast) {
-    trace("var_use");
-    int var_idx = get_data(ast);
-    int var_addr = get_address(vt, var_idx);
-
-    int child_count = get_child_count(ast);
-    
-    if(child_count == 1){
-        // A variável acessada é um vetor e a posição é indicada pelo filho.
-        int offset = get_offset(ast);    
-        push(load(var_addr + offset));
-    }
-    else if(child_count == 0 && get_size(vt, var_idx) != 0){
-         // É um vetor e está sendo usado sem índice, logo é passagem por referência, deve empilhar o endereço.
-         push(var_addr);
-    }
-    else{
-        // É uma variável comum.
-        push(load(var_addr));
-    }
+    // É uma variável comum.
+    push(load(frame_addr(ast)));
 }
 
-void print_string(char* s){
-    int i = 0;
-    int j = 0;
+void run_var_use_arr(AST* ast) {
+    // É um vetor e está sendo usado sem índice, logo é passagem por referência, deve empilhar o endereço.
+    push(frame_addr(ast));
+}
 
-    int len = strlen(s);
-    char output[len + 1];
+void run_var_use_ref(AST* ast) {
+    // Parâmetro vetor repassado adiante: empilha o endereço que ele guarda.
+    push(ref_base(ast));
+}
 
-    while(s[i + 1] != '\0'){
-        if(s[i] == '\"'){
-            i++;
+void run_write(AST* ast) {
+    AST* str_node = get_child(ast, 0);
+    int str_id = get_data(str_node);
+    io_write(get_string(st, str_id));
+}
+
+// Função da chamada em cauda pendente (-1 se não há nenhuma).
+static int tail_call_id = -1;
+
+// O que a execução precisa de cada função, indexado pelo id na ft.
+// Preenchido por resolve_ast; durante a execução as tabelas não são lidas.
+typedef struct {
+    AST* decl;
+    int arity;
+    int frame_size;
+} FuncInfo;
+
+static FuncInfo* funcs = NULL;
+static AST* main_decl = NULL;
+
+// Chamadas em andamento. O limite é o da pilha de chamadas da VM, para que os
+// dois motores falhem no mesmo programa (e antes de estourar a pilha do C).
+static int call_depth = 0;
+
+// Executa a função num registro de ativação que começa em fp.
+// Uma chamada em cauda só deixa os argumentos na pilha e marca tail_call_id;
+// como nada mais roda depois dela, a execução volta até aqui e a função
+// chamada reaproveita o mesmo registro, sem crescer a pilha do C.
+// Toda chamada deixa exatamente um valor na pilha: o do return, ou 0 se a
+// função é void ou termina sem return.
+static void run_function(int func_id) {
+    if (++call_depth > VM_CALL_STACK_SIZE) {
+        io_flush();
+        fprintf(stderr, "Call stack overflow!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (profiling) {
+        profile_enter(func_id);
+    }
+    for (;;) {
+        FuncInfo* f = &funcs[func_id];
+        int base = sp - f->arity;
+        frame_top = fp + f->frame_size;
+        if (frame_top > MEM_SIZE) {
+            io_flush();
+            fprintf(stderr, "Stack overflow!\n");
+            exit(EXIT_FAILURE);
         }
-        else if(s[i] == '\\' && s[i + 1] == 'n'){
-            output[j] = '\n';
-            j++;
-            i += 2;
+        // Variáveis locais começam zeradas, mesmo num registro reaproveitado
+        // (as primeiras células são dos parâmetros, escritos logo em seguida).
+        if (f->frame_size > f->arity) {
+            memset(&mem[fp + f->arity], 0, (f->frame_size - f->arity) * sizeof(int));
         }
-        else{
-            output[j] = s[i];
-            j++;
-            i++;
+        return_value = 0;
+        rec_run_ast(f->decl);
+        returning = 0;
+        if (tail_call_id == -1) {
+            sp = base;
+            push(return_value);
+            break;
         }
+        func_id = tail_call_id;
+        tail_call_id = -1;
+        if (profiling) {
+            profile_replace(func_id);
+        }
+    }
+    if (profiling) {
+        profile_leave();
     }
+    call_depth--;
+}
 
-    output[j] = '\0';
+// Cada chamada do programa ocupa alguns registros de rec_run_ast na pilha do
+// C, então o programa roda numa pilha própria, grande o bastante para chegar
+// ao limite de chamadas (como a pilha do JIT, só é ocupada conforme o uso).
+#define WALKER_STACK_SIZE ((size_t) 256 << 20)
 
-    printf("%s", output);
-}
+static ucontext_t walker_caller;
+static int walker_main_id;
 
-void run_write(AST* ast) {
-    trace("write");
-    AST* str_node = get_child(ast, 0);
-    int str_id = get_data(str_node);
-    char* s = get_string(st, str_id);
-    print_string(s);
+static void run_main(void) {
+    run_function(walker_main_id);
 }
 
 void run_func_list(AST* ast){
-    trace("func_list");   
-    AST* main_decl_node = NULL;
-
-    int size = get_child_count(ast);
-    for (int i = 0; i < size; i++) {
-        AST* func_decl_node = get_child(ast, i);
-        AST* func_header_node = get_child(func_decl_node, 0);
-        AST* func_name_node = get_child(func_header_node, 0);
-        int func_id = get_data(func_name_node);
-        add_func_node(ft, func_id, func_decl_node);
-        
-        char* name = get_func_name(ft, func_id);
-        
-        if(strcmp(name, "main") == 0){
-            main_decl_node = func_decl_node;
+    if(main_decl != NULL){
+        int main_id = get_data(get_child(get_child(main_decl, 0), 0));
+        fp = 0;
+        if (stats_enabled) {
+            run_stats.calls[main_id]++;
         }
-    }
-
-    if(main_decl_node != NULL){
-        rec_run_ast(main_decl_node);
+        char* walker_stack = mmap(NULL, WALKER_STACK_SIZE, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (walker_stack == MAP_FAILED) {
+            run_function(main_id);
+            return;
+        }
+        ucontext_t walker;
+        getcontext(&walker);
+        walker.uc_stack.ss_sp = walker_stack;
+        walker.uc_stack.ss_size = WALKER_STACK_SIZE;
+        walker.uc_link = &walker_caller;
+        walker_main_id = main_id;
+        makecontext(&walker, run_main, 0);
+        swapcontext(&walker_caller, &walker);
+        munmap(walker_stack, WALKER_STACK_SIZE);
     }
     else{
-        printf("Algo está errado. Main não encontrada.\n");
+        io_write("Algo está errado. Main não encontrada.\n");
     }
 }
 
@@ -436,15 +406,32 @@ void run_func_body(AST* ast){
 void run_output(AST* ast){
     AST* expr = get_child(ast, 0);
     rec_run_ast(expr);
-    printf("%d", pop());
+    io_write_int(pop());
 }
 
 void run_fcall(AST* ast){
     int func_id = get_data(ast);
     AST* arg_list = get_child(ast, 0);
-    rec_run_ast(arg_list);
-    AST* func_node = get_func_node(ft, func_id);
-    rec_run_ast(func_node);
+    rec_run_ast(arg_list); // Os argumentos são avaliados no registro do chamador.
+
+    // O registro da função chamada começa logo após o do chamador.
+    int saved_fp = fp;
+    int saved_top = frame_top;
+    fp = frame_top;
+    run_function(func_id);
+    fp = saved_fp;
+    frame_top = saved_top;
+}
+
+// Chamada usada como comando: o valor de retorno é descartado.
+void run_fcall_stmt(AST* ast){
+    run_fcall(ast);
+    pop();
+}
+
+void run_tail_fcall(AST* ast){
+    rec_run_ast(get_child(ast, 0));
+    tail_call_id = get_data(ast);
 }
 
 void run_arg_list(AST* ast){
@@ -455,65 +442,533 @@ void run_arg_list(AST* ast){
 
 void run_return(AST* ast){
     if(get_child_count(ast) == 1){
-        rec_run_ast(get_child(ast, 0));
+        AST* expr = get_child(ast, 0);
+        rec_run_ast(expr);
+        if(get_kind(expr) != TAIL_CALL_NODE){
+            return_value = pop();
+        }
+    }
+    returning = 1;
+}
+
+// Chamada expandida pelo inliner: o corpo roda no registro corrente e a
+// expressão do return deixa o valor na pilha.
+void run_inline(AST* ast){
+    rec_run_ast(get_child(ast, 0));
+    rec_run_ast(get_child(ast, 1));
+}
+
+void run_invalid(AST* ast) {
+    fprintf(stderr, "Invalid kind: %s!\n", kind2str(get_kind(ast)));
+    exit(EXIT_FAILURE);
+}
+
+// Superinstruções ------------------------------------------------------------
+
+// Os formatos de comando mais comuns nos nossos programas ganham um handler
+// próprio, que faz numa visita só o que antes passava por vários nós e pares
+// push/pop. link_ast reconhece os formatos; cada um tem um contador de sites
+// (nós fundidos) e de hits (execuções), impressos por print_fusion_report.
+
+typedef enum {
+    FUSE_INC,           // v = v + c, v = v - c
+    FUSE_ACC,           // v = v + w, v = v - w
+    FUSE_COPY,          // x = y
+    FUSE_SET_CONST,     // x = c
+    FUSE_LOAD_INDEX,    // x = a[i]
+    FUSE_STORE_INDEX,   // a[i] = y
+    FUSE_BRANCH_VC,     // if/while (v <op> c)
+    FUSE_BRANCH_VV,     // if/while (v <op> w)
+    FUSE_BRANCH_XC,     // if/while (expr <op> c)
+    FUSION_KINDS
+} Fusion;
+
+static const char* fusion_names[FUSION_KINDS] = {
+    "v = v +/- c",
+    "v = v +/- w",
+    "x = y",
+    "x = c",
+    "x = a[i]",
+    "a[i] = y",
+    "branch v <op> c",
+    "branch v <op> w",
+    "branch expr <op> c",
+};
+
+static long fusion_sites[FUSION_KINDS];
+static long fusion_hits[FUSION_KINDS];
+
+int counting_fusions = 0;
+
+// Cada handler fundido tem duas versões: run_<nome>, que só executa, e
+// run_<nome>_counted, que também conta o hit. As duas saem do mesmo corpo,
+// com counted constante; link_ast só escolhe as _counted com
+// counting_fusions, então sem --opt-report nenhum comando paga o contador.
+#define hit(fusion) if (counted) fusion_hits[fusion]++
+
+#define DEF_COUNTED(name)                                               \
+void run_##name(AST* ast) { name(ast, 0); }                             \
+void run_##name##_counted(AST* ast) { name(ast, 1); }
+
+static inline void assign_inc(AST* ast, const int counted) {
+    hit(FUSE_INC);
+    int addr = frame_addr(get_child(ast, 0));
+    store(addr, load(addr) + get_data(get_child(get_child(ast, 1), 1)));
+}
+
+static inline void assign_dec(AST* ast, const int counted) {
+    hit(FUSE_INC);
+    int addr = frame_addr(get_child(ast, 0));
+    store(addr, load(addr) - get_data(get_child(get_child(ast, 1), 1)));
+}
+
+static inline void assign_add_var(AST* ast, const int counted) {
+    hit(FUSE_ACC);
+    int addr = frame_addr(get_child(ast, 0));
+    store(addr, load(addr) + load(frame_addr(get_child(get_child(ast, 1), 1))));
+}
+
+static inline void assign_sub_var(AST* ast, const int counted) {
+    hit(FUSE_ACC);
+    int addr = frame_addr(get_child(ast, 0));
+    store(addr, load(addr) - load(frame_addr(get_child(get_child(ast, 1), 1))));
+}
+
+static inline void assign_copy(AST* ast, const int counted) {
+    hit(FUSE_COPY);
+    store(frame_addr(get_child(ast, 0)), load(frame_addr(get_child(ast, 1))));
+}
+
+static inline void assign_set_const(AST* ast, const int counted) {
+    hit(FUSE_SET_CONST);
+    store(frame_addr(get_child(ast, 0)), get_data(get_child(ast, 1)));
+}
+
+DEF_COUNTED(assign_inc)
+DEF_COUNTED(assign_dec)
+DEF_COUNTED(assign_add_var)
+DEF_COUNTED(assign_sub_var)
+DEF_COUNTED(assign_copy)
+DEF_COUNTED(assign_set_const)
+
+// x = a[i] e a[i] = y, com vetor local ou parâmetro e índice constante ou variável.
+#define DEF_FUSED_INDEXED(name, base, offset)                           \
+static inline void load_##name(AST* ast, const int counted) {           \
+    hit(FUSE_LOAD_INDEX);                                               \
+    AST* rval = get_child(ast, 1);                                      \
+    store(frame_addr(get_child(ast, 0)), load(base(rval) + offset(rval))); \
+}                                                                       \
+static inline void store_##name(AST* ast, const int counted) {          \
+    hit(FUSE_STORE_INDEX);                                              \
+    AST* lval = get_child(ast, 0);                                      \
+    store(base(lval) + offset(lval), load(frame_addr(get_child(ast, 1)))); \
+}                                                                       \
+DEF_COUNTED(load_##name)                                                \
+DEF_COUNTED(store_##name)
+
+DEF_FUSED_INDEXED(idx_const,     local_base, const_offset)
+DEF_FUSED_INDEXED(idx_var,       local_base, var_offset)
+DEF_FUSED_INDEXED(ref_idx_const, ref_base,   const_offset)
+DEF_FUSED_INDEXED(ref_idx_var,   ref_base,   var_offset)
+
+// Comparação seguida de desvio: o teste é calculado direto no handler do
+// if/while, sem empilhar os operandos nem o resultado. Os formatos são
+// variável e constante (vc), duas variáveis (vv) ou uma expressão qualquer
+// e constante (xc).
+#define vc_operands(t)                          \
+    int l = load(frame_addr(get_child(t, 0))); \
+    int r = get_data(get_child(t, 1))
+
+#define vv_operands(t)                          \
+    int l = load(frame_addr(get_child(t, 0))); \
+    int r = load(frame_addr(get_child(t, 1)))
+
+#define xc_operands(t)                          \
+    rec_run_ast(get_child(t, 0));               \
+    int l = pop();                              \
+    int r = get_data(get_child(t, 1))
+
+#define DEF_BRANCH(name, op, shape, fusion)                             \
+static inline int test_##name##_##shape(AST* t, const int counted) {    \
+    hit(fusion);                                                        \
+    shape##_operands(t);                                                \
+    return l op r;                                                      \
+}                                                                       \
+static inline void if_##name##_##shape(AST* ast, const int counted) {   \
+    if (test_##name##_##shape(get_child(ast, 0), counted)) {            \
+        rec_run_ast(get_child(ast, 1));                                 \
+    } else if (get_child_count(ast) == 3) {                             \
+        rec_run_ast(get_child(ast, 2));                                 \
+    }                                                                   \
+}                                                                       \
+static inline void while_##name##_##shape(AST* ast, const int counted) { \
+    AST* test = get_child(ast, 0);                                      \
+    AST* block = get_child(ast, 1);                                     \
+    while (test_##name##_##shape(test, counted)) {                      \
+        rec_run_ast(block);                                             \
+        if (returning) {                                                \
+            return;                                                     \
+        }                                                               \
+    }                                                                   \
+}                                                                       \
+DEF_COUNTED(if_##name##_##shape)                                        \
+DEF_COUNTED(while_##name##_##shape)
+
+#define DEF_BRANCHES(shape, fusion)         \
+    DEF_BRANCH(eq,  ==, shape, fusion)      \
+    DEF_BRANCH(neq, !=, shape, fusion)      \
+    DEF_BRANCH(lt,  <,  shape, fusion)      \
+    DEF_BRANCH(le,  <=, shape, fusion)      \
+    DEF_BRANCH(gt,  >,  shape, fusion)      \
+    DEF_BRANCH(ge,  >=, shape, fusion)
+
+DEF_BRANCHES(vc, FUSE_BRANCH_VC)
+DEF_BRANCHES(vv, FUSE_BRANCH_VV)
+DEF_BRANCHES(xc, FUSE_BRANCH_XC)
+
+void print_fusion_report(FILE* out) {
+    fprintf(out, "fusion: %-20s %8s %14s\n", "pattern", "sites", "hits");
+    for (int f = 0; f < FUSION_KINDS; f++) {
+        fprintf(out, "        %-20s %8ld %14ld\n", fusion_names[f], fusion_sites[f], fusion_hits[f]);
+    }
+}
+
+// Link pass ------------------------------------------------------------------
+
+static int is_const(AST* ast) {
+    return get_kind(ast) == INT_VAL_NODE;
+}
+
+// Escolhe o handler de um operador binário conforme o operando da direita.
+#define select_bin_op(name) \
+    (is_const(get_child(ast, 1)) ? run_##name##_const : run_##name)
+
+// Escolhe o handler de acesso a variável pelo formato do nó.
+static NodeHandler select_var_use(AST* ast) {
+    Storage storage = get_storage(ast);
+    if (get_child_count(ast) == 1) {
+        if (storage == REF_PARAM) {
+            return is_const(get_child(ast, 0)) ? run_var_use_ref_idx_const : run_var_use_ref_idx_var;
+        }
+        return is_const(get_child(ast, 0)) ? run_var_use_idx_const : run_var_use_idx_var;
+    }
+    if (storage == REF_PARAM) {
+        return run_var_use_ref;
+    }
+    if (storage == ARRAY_BASE) {
+        return run_var_use_arr;
+    }
+    return run_var_use;
+}
+
+// Variável simples (nem vetor nem parâmetro vetor), usada sem índice.
+static int is_scalar(AST* ast) {
+    return get_kind(ast) == VAR_USE_NODE && get_child_count(ast) == 0 && get_storage(ast) == FRAME_SLOT;
+}
+
+static NodeHandler fuse(Fusion fusion, NodeHandler handler) {
+    fusion_sites[fusion]++;
+    return handler;
+}
+
+// O handler run_<nome>, ou, para os fundidos, a versão que conta os hits
+// quando counting_fusions está ligado.
+#define plain(name) run_##name
+#define fused(name) (counting_fusions ? run_##name##_counted : run_##name)
+
+// Escolhe o handler de x[i] = y, ou de x = a[i], pelo formato do vetor e do índice.
+#define select_indexed(pick, prefix, arr)                                       \
+    (get_storage(arr) == REF_PARAM                                              \
+        ? (is_const(get_child(arr, 0)) ? pick(prefix##_ref_idx_const) : pick(prefix##_ref_idx_var)) \
+        : (is_const(get_child(arr, 0)) ? pick(prefix##_idx_const) : pick(prefix##_idx_var)))
+
+static NodeHandler select_assign(AST* ast) {
+    AST* lval = get_child(ast, 0);
+    AST* rval = get_child(ast, 1);
+    if (get_child_count(lval) == 1) {
+        if (is_scalar(rval)) {
+            return fuse(FUSE_STORE_INDEX, select_indexed(fused, store, lval));
+        }
+        return select_indexed(plain, assign, lval);
+    }
+    if (!is_scalar(lval)) {
+        return run_assign;
+    }
+    if (is_scalar(rval)) {
+        return fuse(FUSE_COPY, fused(assign_copy));
+    }
+    if (is_const(rval)) {
+        return fuse(FUSE_SET_CONST, fused(assign_set_const));
+    }
+    if (get_kind(rval) == VAR_USE_NODE && get_child_count(rval) == 1) {
+        return fuse(FUSE_LOAD_INDEX, select_indexed(fused, load, rval));
+    }
+    NodeKind kind = get_kind(rval);
+    if (kind == PLUS_NODE || kind == MINUS_NODE) {
+        AST* var = get_child(rval, 0);
+        AST* step = get_child(rval, 1);
+        if (is_scalar(var) && get_slot(var) == get_slot(lval)) {
+            if (is_const(step)) {
+                return fuse(FUSE_INC, kind == PLUS_NODE ? fused(assign_inc) : fused(assign_dec));
+            }
+            if (is_scalar(step)) {
+                return fuse(FUSE_ACC, kind == PLUS_NODE ? fused(assign_add_var) : fused(assign_sub_var));
+            }
+        }
+    }
+    return run_assign;
+}
+
+// Handlers fundidos de if/while, por formato do teste e operador; a segunda
+// tabela de cada um tem as versões que contam os hits.
+#define BRANCH_ROW(stmt, shape, variant)                                                \
+    { run_##stmt##_eq_##shape##variant, run_##stmt##_neq_##shape##variant,              \
+      run_##stmt##_lt_##shape##variant, run_##stmt##_le_##shape##variant,               \
+      run_##stmt##_gt_##shape##variant, run_##stmt##_ge_##shape##variant }
+
+#define BRANCH_TABLE(stmt, variant) \
+    { BRANCH_ROW(stmt, vc, variant), BRANCH_ROW(stmt, vv, variant), BRANCH_ROW(stmt, xc, variant) }
+
+static NodeHandler if_branches[2][3][6] = {
+    BRANCH_TABLE(if, ), BRANCH_TABLE(if, _counted)
+};
+
+static NodeHandler while_branches[2][3][6] = {
+    BRANCH_TABLE(while, ), BRANCH_TABLE(while, _counted)
+};
+
+static int cmp_index(NodeKind kind) {
+    switch(kind) {
+        case EQ_NODE:   return 0;
+        case NEQ_NODE:  return 1;
+        case LT_NODE:   return 2;
+        case LE_NODE:   return 3;
+        case GT_NODE:   return 4;
+        case GE_NODE:   return 5;
+        default:        return -1;
+    }
+}
+
+// if e while cujo teste é uma comparação com formato conhecido viram um
+// handler só; os demais ficam com o genérico.
+static NodeHandler select_branch(AST* ast, NodeHandler (*table)[6], NodeHandler generic) {
+    AST* test = get_child(ast, 0);
+    int op = cmp_index(get_kind(test));
+    if (op == -1) {
+        return generic;
+    }
+    AST* l = get_child(test, 0);
+    AST* r = get_child(test, 1);
+    if (is_scalar(l) && is_const(r)) {
+        return fuse(FUSE_BRANCH_VC, table[0][op]);
+    }
+    if (is_scalar(l) && is_scalar(r)) {
+        return fuse(FUSE_BRANCH_VV, table[1][op]);
+    }
+    if (is_const(r)) {
+        return fuse(FUSE_BRANCH_XC, table[2][op]);
     }
+    return generic;
 }
 
-void rec_run_ast(AST* ast) {
+static NodeHandler select_handler(AST* ast) {
     switch(get_kind(ast)) {
-        case ASSIGN_NODE:           run_assign(ast);        break;
-        case BLOCK_NODE:            run_block(ast);         break;
-        case INPUT_NODE:            run_input(ast);          break;
-        case INT_VAL_NODE:          run_int_val(ast);       break;
-        case FUNC_LIST_NODE:        run_func_list(ast);     break;
-        case FUNCTION_DECL_NODE:    run_func_decl(ast);     break;
-        case FUNCTION_HEADER_NODE:  run_func_header(ast);   break;
-        case FUNCTION_BODY_NODE:    run_func_body(ast);     break;
-        case VAR_LIST_NODE:         run_var_list(ast);      break;
-        case VAR_USE_NODE:          run_var_use(ast);       break;
-        
-        case WRITE_NODE:            run_write(ast);         break;
-        case OUTPUT_NODE:           run_output(ast);        break;
-        
+        case ASSIGN_NODE:           return select_assign(ast);
+        case BLOCK_NODE:            return run_block;
+        case INPUT_NODE:            return run_input;
+        case INT_VAL_NODE:          return run_int_val;
+        case FUNC_LIST_NODE:        return run_func_list;
+        case FUNCTION_DECL_NODE:    return run_func_decl;
+        case FUNCTION_HEADER_NODE:  return run_func_header;
+        case FUNCTION_BODY_NODE:    return run_func_body;
+        case VAR_LIST_NODE:         return run_var_list;
+        case VAR_USE_NODE:          return select_var_use(ast);
+
+        case WRITE_NODE:            return run_write;
+        case OUTPUT_NODE:           return run_output;
+
         /* Arithmetic. */
-        case PLUS_NODE:             run_plus(ast);          break;
-        case MINUS_NODE:            run_minus(ast);         break;
-        case TIMES_NODE:            run_times(ast);         break;
-        case OVER_NODE:             run_over(ast);          break;
+        case PLUS_NODE:             return select_bin_op(plus);
+        case MINUS_NODE:            return select_bin_op(minus);
+        case TIMES_NODE:            return select_bin_op(times);
+        case OVER_NODE:             return select_bin_op(over);
+        case SHL_NODE:              return select_bin_op(shl);
 
         /* Conditionals: */
-        case IF_NODE:               run_if(ast);            break;
+        case IF_NODE:               return select_branch(ast, if_branches[counting_fusions], run_if);
+
+        case EQ_NODE:               return select_bin_op(eq);
+        case NEQ_NODE:              return select_bin_op(neq);
 
-        case EQ_NODE:               run_eq(ast);            break;
-        case NEQ_NODE:              run_neq(ast);           break;
-        
-        case LE_NODE:               run_le(ast);            break;
-        case LT_NODE:               run_lt(ast);            break;
+        case LE_NODE:               return select_bin_op(le);
+        case LT_NODE:               return select_bin_op(lt);
 
-        case GE_NODE:               run_ge(ast);            break;
-        case GT_NODE:               run_gt(ast);            break;
-        
+        case GE_NODE:               return select_bin_op(ge);
+        case GT_NODE:               return select_bin_op(gt);
 
         /* Loop: */
-        case WHILE_NODE:            run_while(ast);         break;
+        case WHILE_NODE:            return select_branch(ast, while_branches[counting_fusions], run_while);
 
         /* Function call: */
-        case FUNCTION_CALL_NODE:    run_fcall(ast);         break;
-        case ARG_LIST_NODE:         run_arg_list(ast);      break;
-        case RETURN_NODE:           run_return(ast);        break;
+        case FUNCTION_CALL_NODE:    return run_fcall;
+        case TAIL_CALL_NODE:        return run_tail_fcall;
+        case ARG_LIST_NODE:         return run_arg_list;
+        case RETURN_NODE:           return run_return;
+        case INLINE_NODE:           return run_inline;
 
-        case VAR_DECL_NODE:         run_var_decl(ast);      break;
+        case VAR_DECL_NODE:         return run_var_decl;
 
-        default:
-            fprintf(stderr, "Invalid kind: %s!\n", kind2str(get_kind(ast)));
-            exit(EXIT_FAILURE);
+        default:                    return run_invalid;
+    }
+}
+
+// Resolve, antes da execução, tudo o que o interpretador buscaria nas tabelas:
+// a classe de armazenamento e a célula de cada nó de variável, e o nó, a
+// aridade e o tamanho do registro de cada função.
+// (C-Minus não tem variáveis globais, então toda célula é relativa a fp.)
+static void resolve_vars(AST* ast) {
+    NodeKind kind = get_kind(ast);
+    if (kind == VAR_USE_NODE || kind == VAR_DECL_NODE) {
+        int var_idx = get_data(ast);
+        int size = get_size(vt, var_idx);
+        Storage storage = size == -1 ? REF_PARAM : size > 0 ? ARRAY_BASE : FRAME_SLOT;
+        set_storage(ast, storage, get_address(vt, var_idx));
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        resolve_vars(get_child(ast, i));
+    }
+}
+
+void resolve_ast(AST* ast) {
+    int size = get_child_count(ast);
+    free(funcs);
+    funcs = malloc(size * sizeof(FuncInfo));
+    main_decl = NULL;
+    for (int i = 0; i < size; i++) {
+        AST* func_decl_node = get_child(ast, i);
+        int func_id = get_data(get_child(get_child(func_decl_node, 0), 0));
+        funcs[func_id].decl = func_decl_node;
+        funcs[func_id].arity = get_func_arity(ft, func_id);
+        funcs[func_id].frame_size = get_frame_size(vt, get_func_scope(ft, func_id));
+        if (strcmp(get_func_name(ft, func_id), "main") == 0) {
+            main_decl = func_decl_node;
+        }
+    }
+    resolve_vars(ast);
+}
+
+// Grava em cada nó o handler que o executa.
+void link_ast(AST* ast) {
+    set_handler(ast, select_handler(ast));
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* child = get_child(ast, i);
+        link_ast(child);
+        if (get_kind(ast) == BLOCK_NODE && get_kind(child) == FUNCTION_CALL_NODE) {
+            set_handler(child, run_fcall_stmt);
+        }
+    }
+}
+
+// Instrumentação (--stats e --trace) ------------------------------------------
+
+// Com --stats ou --trace todo nó ganha run_instrumented como handler e o
+// handler escolhido por link_ast fica numa tabela à parte, indexada pelo
+// endereço do nó. Assim os nós e os handlers de uma execução sem essas opções
+// continuam exatamente os mesmos, sem nenhum teste a mais por nó.
+
+typedef struct {
+    AST* node;
+    NodeHandler handler;
+} WrappedNode;
+
+static WrappedNode* wrapped = NULL;
+static size_t wrapped_mask = 0;
+
+static int current_func = -1; // só para o trace: função em execução, no ft
+
+static size_t wrapped_slot(AST* ast) {
+    size_t h = (size_t) (((uintptr_t) ast >> 3) * 0x9E3779B97F4A7C15ull >> 16) & wrapped_mask;
+    while (wrapped[h].node != NULL && wrapped[h].node != ast) {
+        h = (h + 1) & wrapped_mask;
+    }
+    return h;
+}
+
+static void run_instrumented(AST* ast) {
+    NodeKind kind = get_kind(ast);
+    int saved_func = current_func;
+    if (kind == FUNCTION_DECL_NODE) {
+        current_func = get_data(get_child(get_child(ast, 0), 0));
+    }
+    if (tracing) {
+        trace_event(kind, current_func, sp + 1, sp >= 0 ? stack[sp] : 0);
+    }
+    if (stats_enabled) {
+        run_stats.steps++;
+        run_stats.by_kind[kind]++;
+        if (kind == FUNCTION_CALL_NODE || kind == TAIL_CALL_NODE) {
+            run_stats.calls[get_data(ast)]++;
+        }
+    }
+    wrapped[wrapped_slot(ast)].handler(ast);
+    current_func = saved_func;
+    if (stats_enabled) {
+        if (sp + 1 > run_stats.max_stack) {
+            run_stats.max_stack = sp + 1;
+        }
+        if (frame_top > run_stats.max_mem) {
+            run_stats.max_mem = frame_top;
+        }
     }
 }
 
+static size_t count_tree(AST* ast) {
+    size_t n = 1;
+    for (int i = 0; i < get_child_count(ast); i++) {
+        n += count_tree(get_child(ast, i));
+    }
+    return n;
+}
+
+static void wrap_tree(AST* ast) {
+    size_t h = wrapped_slot(ast);
+    if (wrapped[h].node == NULL) {
+        wrapped[h].node = ast;
+        wrapped[h].handler = get_handler(ast);
+        set_handler(ast, run_instrumented);
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        wrap_tree(get_child(ast, i));
+    }
+}
+
+static void link_instrumented(AST* ast) {
+    size_t size = 16;
+    while (size < 2 * count_tree(ast)) {
+        size *= 2;
+    }
+    wrapped = calloc(size, sizeof(WrappedNode));
+    wrapped_mask = size - 1;
+    wrap_tree(ast);
+}
+
 // ----------------------------------------------------------------------------
 
 void run_ast(AST* ast) {
     init_stack();
     init_mem();
+    returning = 0;
+    tail_call_id = -1;
+    memset(fusion_sites, 0, sizeof fusion_sites);
+    memset(fusion_hits, 0, sizeof fusion_hits);
+    resolve_ast(ast);
+    link_ast(ast);
+    if (stats_enabled || tracing) {
+        link_instrumented(ast);
+    }
     rec_run_ast(ast);
+    free(funcs);
+    funcs = NULL;
+    free(wrapped);
+    wrapped = NULL;
 }
@@ -1,8 +1,26 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include <stdio.h>
 #include "ast.h"
 
+// Caches in the nodes (and in a per-function table) everything execution
+// would otherwise look up in the symbol tables (called by run_ast).
+void resolve_ast(AST *ast);
+
+// Stores in every node the handler that executes it (called by run_ast,
+// after resolve_ast).
+void link_ast(AST *ast);
+
 void run_ast(AST *ast);
 
+// Set (to 1) before run_ast to count how many times each fused statement
+// runs: link_ast then picks the fused handlers that count. Without it the
+// fused handlers count nothing and the hits in the report stay at 0.
+extern int counting_fusions;
+
+// Prints, for each fused statement shape, how many nodes link_ast fused and
+// how many times they ran in the last run_ast (with counting_fusions).
+void print_fusion_report(FILE* out);
+
 #endif
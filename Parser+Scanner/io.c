@@ -0,0 +1,250 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "io.h"
+
+// Buffer de saída ------------------------------------------------------------
+
+// Toda a saída do programa (output, write e o prompt do input) passa por
+// aqui em vez de printf, que formata e trava o FILE a cada chamada.
+
+#define IO_BUFFER_SIZE (1 << 16)
+
+static char buffer[IO_BUFFER_SIZE];
+static size_t used = 0;
+static int line_buffered = 0;
+static int batch = 0;
+static int interactive = 0; // stdin é um terminal: o prompt tem que aparecer antes da leitura
+static long long flushed = 0; // bytes já entregues a stdout, para o --stats
+
+void io_flush(void) {
+    size_t done = 0;
+    while (done < used) {
+        ssize_t n = write(STDOUT_FILENO, buffer + done, used - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            break; // stdout fechada: não há para onde mandar o resto.
+        }
+        done += n;
+    }
+    flushed += used;
+    used = 0;
+}
+
+void io_init(int line, int batch_input) {
+    static int registered = 0;
+    // O que já foi escrito com stdio (mensagens do front-end) sai antes.
+    fflush(stdout);
+    line_buffered = line;
+    batch = batch_input;
+    interactive = isatty(STDIN_FILENO);
+    used = 0;
+    if (!registered) {
+        atexit(io_flush);
+        registered = 1;
+    }
+}
+
+void io_write(const char* s) {
+    size_t len = strlen(s);
+    int newline = line_buffered && memchr(s, '\n', len) != NULL;
+    while (len > 0) {
+        if (used == IO_BUFFER_SIZE) {
+            io_flush();
+        }
+        size_t n = IO_BUFFER_SIZE - used < len ? IO_BUFFER_SIZE - used : len;
+        memcpy(buffer + used, s, n);
+        used += n;
+        s += n;
+        len -= n;
+    }
+    if (newline) {
+        io_flush();
+    }
+}
+
+void io_write_int(int n) {
+    char digits[10];
+    int k = sizeof digits;
+    unsigned u = n < 0 ? -(unsigned) n : (unsigned) n;
+    do {
+        digits[--k] = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+
+    if (IO_BUFFER_SIZE - used < sizeof digits + 1) {
+        io_flush();
+    }
+    if (n < 0) {
+        buffer[used++] = '-';
+    }
+    memcpy(buffer + used, digits + k, sizeof digits - k);
+    used += sizeof digits - k;
+}
+
+// Entrada --------------------------------------------------------------------
+
+// No modo batch a entrada é lida direto do descritor 0 em blocos grandes e
+// os números são convertidos aqui mesmo, sem scanf (que não pode ser
+// misturado com isso, porque guarda seu próprio buffer de stdin).
+
+#define INPUT_BUFFER_SIZE (1 << 20)
+
+static char* in_buf = NULL;
+static size_t in_pos = 0;
+static size_t in_end = 0;
+static int in_eof = 0;
+static long in_count = 0; // valores lidos até agora, para a mensagem de erro
+static long long in_read = 0; // bytes lidos de stdin pelo modo batch
+static long long in_scanned = 0; // bytes consumidos pelo scanf fora do modo batch
+
+// Descarta o que já foi consumido e lê mais um bloco depois do que sobrou.
+// Devolve 0 quando não há mais nada para ler. Os 8 bytes depois do último
+// lido são sempre '\0', que não é espaço nem dígito: os laços de batch_input
+// param neles sem comparar a posição com o fim a cada caractere, e
+// leading_digits pode ler uma palavra inteira a partir de qualquer posição.
+static int refill(void) {
+    if (in_buf == NULL) {
+        in_buf = malloc(INPUT_BUFFER_SIZE + 8);
+    }
+    size_t rest = in_end - in_pos;
+    memmove(in_buf, in_buf + in_pos, rest);
+    in_pos = 0;
+    in_end = rest;
+    int more = 0;
+    while (!in_eof) {
+        ssize_t n = read(STDIN_FILENO, in_buf + in_end, INPUT_BUFFER_SIZE - in_end);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            in_eof = 1;
+            break;
+        }
+        in_end += n;
+        in_read += n;
+        more = 1;
+        break;
+    }
+    memset(in_buf + in_end, 0, 8);
+    return more;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void input_error(char* what) {
+    io_flush();
+    fprintf(stderr, "input(): %s after %ld value%s.\n", what, in_count, in_count == 1 ? "" : "s");
+    exit(EXIT_FAILURE);
+}
+
+#define ONES 0x0101010101010101ULL
+
+// Converte os dígitos no começo de p, até 8, de uma vez só (SWAR): acha o
+// primeiro byte que não é dígito e junta os valores dois a dois, quatro a
+// quatro e oito a oito com multiplicações. p[0] precisa ser dígito e os 8
+// bytes a partir de p precisam poder ser lidos. Devolve quantos dígitos usou.
+static int leading_digits(const char* p, unsigned* value) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    // Um byte é dígito se o nibble alto é 3 e continua 3 depois de somar 6.
+    uint64_t bad = ((w & (0xF0 * ONES)) ^ (0x30 * ONES))
+                 | (((w + 0x06 * ONES) & (0xF0 * ONES)) ^ (0x30 * ONES));
+    uint64_t nonzero = (((bad & (0x7F * ONES)) + 0x7F * ONES) | bad) & (0x80 * ONES);
+    int len = nonzero ? __builtin_ctzll(nonzero) >> 3 : 8;
+
+    uint64_t x = w - 0x30 * ONES;
+    if (len < 8) {
+        x <<= 64 - 8 * len; // zeros à esquerda no lugar dos bytes que não são do número
+    }
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x * 10000 + (x >> 32)) & 0xFFFFFFFFULL;
+    *value = (unsigned) x;
+    return len;
+}
+
+static int batch_input(void) {
+    if (in_buf == NULL) {
+        refill();
+    }
+    for (;;) {
+        while (is_space(in_buf[in_pos])) {
+            in_pos++;
+        }
+        if (in_pos < in_end) {
+            break;
+        }
+        if (!refill()) {
+            input_error("end of input");
+        }
+    }
+    // Um número pode chegar dividido entre dois read (um pipe entrega o que
+    // foi escrito até ali), então nenhum fim de bloco conta como fim do
+    // número: só um byte que não é dígito, ou o fim da entrada.
+
+    // Sem desvio: em dados reais o sinal varia sem padrão e o preditor erra.
+    char sign = in_buf[in_pos];
+    int negative = sign == '-';
+    in_pos += negative | (sign == '+');
+    while (in_pos == in_end && refill()) {
+        // O sinal era o último byte do bloco; o primeiro dígito vem no próximo.
+    }
+    if ((unsigned) (in_buf[in_pos] - '0') > 9) {
+        input_error("not an integer");
+    }
+    // Módulo 2^32, como a aritmética do resto da linguagem.
+    unsigned n;
+    int len = leading_digits(in_buf + in_pos, &n);
+    in_pos += len;
+    if (len == 8 || in_pos == in_end) {
+        // Número comprido, ou que pode continuar no próximo bloco: o resto,
+        // dígito a dígito.
+        for (;;) {
+            unsigned d;
+            while ((d = (unsigned) (in_buf[in_pos] - '0')) <= 9) {
+                n = n * 10 + d;
+                in_pos++;
+            }
+            if (in_pos < in_end || !refill()) {
+                break;
+            }
+        }
+    }
+    in_count++;
+    return (int) (negative ? -n : n);
+}
+
+int io_input(void) {
+    if (batch) {
+        return batch_input();
+    }
+    int n;
+    io_write("input: ");
+    if (interactive || line_buffered) {
+        io_flush();
+    }
+    int len = 0;
+    if (scanf("%d%n", &n, &len) == 1) {
+        in_scanned += len;
+        return n;
+    }
+    io_write("Falha ao ler entrada.\n");
+    return 0;
+}
+
+long long io_bytes_in(void) {
+    // No modo batch o que ainda está no buffer foi lido mas não consumido.
+    return in_scanned + in_read - (long long) (in_end - in_pos);
+}
+
+long long io_bytes_out(void) {
+    return flushed + used;
+}
@@ -0,0 +1,32 @@
+#ifndef IO_H
+#define IO_H
+
+// Program I/O shared by every engine.
+// ----------------------------------------------------------------------------
+
+// Output goes to a large user-space buffer, written to stdout when it is
+// full, before input() reads and at exit. With 'line_buffered' it is also
+// written after every line break (for interactive use).
+// In 'batch' mode input() reads stdin in large blocks with its own integer
+// parser and prints no prompt; running out of input (or a token that is not
+// an integer) ends the program with a message on stderr.
+void io_init(int line_buffered, int batch);
+
+// Appends a string (already decoded, see add_literal) to the output.
+void io_write(const char* s);
+
+// Appends the decimal form of n to the output.
+void io_write_int(int n);
+
+// Reads one integer from stdin. Interactively it prints the "input: " prompt
+// first and, on failure, prints the error message and returns 0.
+int io_input(void);
+
+// Writes out everything buffered so far.
+void io_flush(void);
+
+// Bytes consumed by input() and produced by output/write/the prompt so far.
+long long io_bytes_in(void);
+long long io_bytes_out(void);
+
+#endif // IO_H
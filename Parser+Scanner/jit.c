@@ -0,0 +1,936 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "compilation.h"
+#include "jit.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include "tables.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
+#include "vm.h"
+
+// Geração de código para x86-64 direto da AST.
+//
+// Cada função vira uma função nativa com a convenção do System V: até seis
+// argumentos em rdi, rsi, rdx, rcx, r8 e r9 e o resultado em eax. As células
+// do registro de ativação ficam na pilha nativa, 8 bytes cada (vetores
+// recebidos por referência guardam um ponteiro de verdade), e as variáveis
+// escalares mais usadas moram nos registradores callee-saved. Expressões são
+// avaliadas em eax, com os temporários empilhados com push/pop.
+// ----------------------------------------------------------------------------
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+static const int arg_regs[] = { RDI, RSI, RDX, RCX, R8, R9 };
+#define MAX_REG_ARGS 6
+
+// Registradores que guardam variáveis; a função chamada os preserva.
+static const int var_regs[] = { RBX, R12, R13, R14 };
+#define MAX_REG_VARS 4
+
+// r15 guarda quantas chamadas ainda cabem: o prólogo decrementa e emit_leave
+// incrementa. O limite é o da pilha de chamadas da VM, para que os motores
+// falhem nos mesmos programas; num registro, e não na memória, a contagem
+// não cria uma dependência entre as chamadas.
+#define CALL_BUDGET R15
+
+// Códigos de condição (jcc/setcc). Negar uma condição é trocar o bit 0.
+enum { CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+// Pilha em que o código gerado roda, para que a recursão não dependa do
+// limite da pilha do processo. A margem no fim fica para os helpers em C.
+#define JIT_STACK_SIZE ((size_t) 256 << 20)
+#define JIT_STACK_MARGIN (64 << 10)
+
+static char* jit_stack_limit;
+
+// Code buffer ----------------------------------------------------------------
+
+typedef struct {
+    int at;      // posição do rel32 a ajustar
+    int func_id; // função chamada
+} CallPatch;
+
+typedef struct {
+    unsigned char* code;
+    int size;
+    int capacity;
+
+    int* entry;         // endereço de cada função no código
+    CallPatch* patches; // chamadas emitidas antes de a função chamada existir
+    int patch_count;
+    int patch_capacity;
+    int overflow_stub;      // estouro da pilha do JIT
+    int call_overflow_stub; // estouro do limite de chamadas
+
+    // Estado da função sendo compilada.
+    int depth;         // quantos temporários estão empilhados agora
+    int cell_base;     // deslocamento da célula 0 em relação a rbp
+    int reg_count;     // quantos registradores de var_regs estão em uso
+    int reg_var[MAX_REG_VARS];
+
+    char* unsupported; // motivo para desistir do programa, ou NULL
+} Jit;
+
+static void emit_byte(Jit* j, int b) {
+    if (j->size == j->capacity) {
+        j->capacity = j->capacity == 0 ? 4096 : 2 * j->capacity;
+        j->code = realloc(j->code, j->capacity);
+    }
+    j->code[j->size++] = (unsigned char) b;
+}
+
+static void emit_dword(Jit* j, int32_t v) {
+    for (int i = 0; i < 4; i++) {
+        emit_byte(j, (v >> (8 * i)) & 0xFF);
+    }
+}
+
+static void emit_qword(Jit* j, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        emit_byte(j, (v >> (8 * i)) & 0xFF);
+    }
+}
+
+static void patch_rel32(Jit* j, int at, int target) {
+    int32_t rel = target - (at + 4);
+    memcpy(j->code + at, &rel, 4);
+}
+
+// Operandos --------------------------------------------------------------------
+
+typedef enum { OPD_REG, OPD_MEM, OPD_IMM } OperandKind;
+
+// Um registrador, a célula [rbp + disp] ou uma constante.
+typedef struct {
+    OperandKind kind;
+    int reg;
+    int disp;
+    int imm;
+} Operand;
+
+static Operand reg_operand(int reg) {
+    Operand o = { OPD_REG, reg, 0, 0 };
+    return o;
+}
+
+static Operand mem_operand(int disp) {
+    Operand o = { OPD_MEM, RBP, disp, 0 };
+    return o;
+}
+
+static Operand imm_operand(int imm) {
+    Operand o = { OPD_IMM, 0, 0, imm };
+    return o;
+}
+
+static void emit_opcode(Jit* j, int op) {
+    if (op > 0xFF) {
+        emit_byte(j, op >> 8);
+    }
+    emit_byte(j, op & 0xFF);
+}
+
+// op reg, r/m (ou r/m, reg, conforme o opcode). w = 1 para operandos de 64 bits.
+static void emit_rm(Jit* j, int w, int op, int reg, Operand rm) {
+    int rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm.kind == OPD_REG && (rm.reg & 8) ? 1 : 0);
+    if (rex != 0x40) {
+        emit_byte(j, rex);
+    }
+    emit_opcode(j, op);
+    if (rm.kind == OPD_REG) {
+        emit_byte(j, 0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+    }
+    else {
+        emit_byte(j, 0x80 | (reg & 7) << 3 | RBP);
+        emit_dword(j, rm.disp);
+    }
+}
+
+// op reg, [base + index * 8 + disp].
+static void emit_indexed(Jit* j, int w, int op, int reg, int base, int index, int disp) {
+    int rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (index & 8 ? 2 : 0) | (base & 8 ? 1 : 0);
+    if (rex != 0x40) {
+        emit_byte(j, rex);
+    }
+    emit_opcode(j, op);
+    emit_byte(j, 0x80 | (reg & 7) << 3 | 4);
+    emit_byte(j, 3 << 6 | (index & 7) << 3 | (base & 7));
+    emit_dword(j, disp);
+}
+
+static void emit_push(Jit* j, int reg) {
+    if (reg & 8) {
+        emit_byte(j, 0x41);
+    }
+    emit_byte(j, 0x50 | (reg & 7));
+}
+
+static void emit_pop(Jit* j, int reg) {
+    if (reg & 8) {
+        emit_byte(j, 0x41);
+    }
+    emit_byte(j, 0x58 | (reg & 7));
+}
+
+// mov reg32, operando.
+static void emit_load(Jit* j, int reg, Operand src) {
+    if (src.kind == OPD_IMM) {
+        if (reg & 8) {
+            emit_byte(j, 0x41);
+        }
+        emit_byte(j, 0xB8 | (reg & 7));
+        emit_dword(j, src.imm);
+    }
+    else {
+        emit_rm(j, 0, 0x8B, reg, src);
+    }
+}
+
+static void emit_mov_imm64(Jit* j, int reg, uint64_t imm) {
+    emit_byte(j, 0x48 | (reg & 8 ? 1 : 0));
+    emit_byte(j, 0xB8 | (reg & 7));
+    emit_qword(j, imm);
+}
+
+// Emite um salto (0xE9), chamada (0xE8) ou jcc e devolve a posição do rel32.
+static int emit_jump(Jit* j, int op) {
+    emit_opcode(j, op);
+    int at = j->size;
+    emit_dword(j, 0);
+    return at;
+}
+
+static int emit_jcc(Jit* j, int cc) {
+    return emit_jump(j, 0x0F80 | cc);
+}
+
+static void emit_push_temp(Jit* j) {
+    emit_push(j, RAX);
+    j->depth++;
+}
+
+static void emit_pop_temp(Jit* j, int reg) {
+    emit_pop(j, reg);
+    j->depth--;
+}
+
+// Chamadas para fora do código gerado exigem rsp alinhado em 16 bytes; no
+// corpo da função ele está alinhado, então só os temporários atrapalham.
+static void emit_call_helper(Jit* j, void* fn) {
+    int pad = j->depth % 2;
+    if (pad) {
+        emit_byte(j, 0x48); emit_byte(j, 0x83); emit_byte(j, 0xEC); emit_byte(j, 8); // sub rsp, 8
+    }
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) fn);
+    emit_byte(j, 0x41); emit_byte(j, 0xFF); emit_byte(j, 0xD3);                     // call r11
+    if (pad) {
+        emit_byte(j, 0x48); emit_byte(j, 0x83); emit_byte(j, 0xC4); emit_byte(j, 8); // add rsp, 8
+    }
+}
+
+// Runtime helpers --------------------------------------------------------------
+
+static int jit_input(void) {
+    return io_input();
+}
+
+static void jit_output(int n) {
+    io_write_int(n);
+}
+
+static void jit_write(char* s) {
+    io_write(s);
+}
+
+static void jit_stack_overflow(void) {
+    io_flush();
+    fprintf(stderr, "Stack overflow!\n");
+    exit(EXIT_FAILURE);
+}
+
+static void jit_call_overflow(void) {
+    io_flush();
+    fprintf(stderr, "Call stack overflow!\n");
+    exit(EXIT_FAILURE);
+}
+
+// Variables --------------------------------------------------------------------
+
+static Operand var_operand(Jit* j, int var_idx) {
+    for (int i = 0; i < j->reg_count; i++) {
+        if (j->reg_var[i] == var_idx) {
+            return reg_operand(var_regs[i]);
+        }
+    }
+    return mem_operand(j->cell_base + 8 * get_address(vt, var_idx));
+}
+
+static int is_scalar_use(AST* ast) {
+    return get_kind(ast) == VAR_USE_NODE && get_child_count(ast) == 0 && get_size(vt, get_data(ast)) == 0;
+}
+
+typedef struct {
+    int var_idx;
+    int weight;
+} VarWeight;
+
+typedef struct {
+    VarWeight* t;
+    int size;
+    int capacity;
+} VarWeights;
+
+// Conta os usos de cada variável escalar; usos dentro de laços pesam mais.
+static void count_uses(AST* ast, int weight, VarWeights* w) {
+    if (get_kind(ast) == VAR_USE_NODE && get_size(vt, get_data(ast)) == 0) {
+        int i = 0;
+        while (i < w->size && w->t[i].var_idx != get_data(ast)) {
+            i++;
+        }
+        if (i == w->size) {
+            if (w->size == w->capacity) {
+                w->capacity = w->capacity == 0 ? 16 : 2 * w->capacity;
+                w->t = realloc(w->t, w->capacity * sizeof(VarWeight));
+            }
+            w->t[w->size].var_idx = get_data(ast);
+            w->t[w->size].weight = 0;
+            w->size++;
+        }
+        w->t[i].weight += weight;
+    }
+    if (get_kind(ast) == WHILE_NODE && weight < (1 << 20)) {
+        weight *= 8;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        count_uses(get_child(ast, i), weight, w);
+    }
+}
+
+// Escolhe as variáveis que vão para registradores.
+static void assign_registers(Jit* j, AST* body) {
+    VarWeights w = { NULL, 0, 0 };
+    count_uses(body, 1, &w);
+    j->reg_count = 0;
+    while (j->reg_count < MAX_REG_VARS) {
+        int best = -1;
+        for (int i = 0; i < w.size; i++) {
+            if (w.t[i].weight > 0 && (best == -1 || w.t[i].weight > w.t[best].weight)) {
+                best = i;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+        j->reg_var[j->reg_count++] = w.t[best].var_idx;
+        w.t[best].weight = 0;
+    }
+    free(w.t);
+}
+
+// Expressions ----------------------------------------------------------------
+
+static void compile_expr(Jit* j, AST* ast);
+static void compile_stmt(Jit* j, AST* ast);
+
+// Operando direto para o lado direito de uma operação, sem passar por eax.
+static int simple_operand(Jit* j, AST* ast, Operand* o) {
+    if (get_kind(ast) == INT_VAL_NODE) {
+        *o = imm_operand(get_data(ast));
+        return 1;
+    }
+    if (is_scalar_use(ast)) {
+        *o = var_operand(j, get_data(ast));
+        return 1;
+    }
+    return 0;
+}
+
+// Deixa o lado esquerdo em eax e devolve o direito como operando.
+// Se o direito não é simples, ele é calculado em ecx.
+static Operand compile_operands(Jit* j, AST* ast) {
+    Operand right;
+    compile_expr(j, get_child(ast, 0));
+    if (!simple_operand(j, get_child(ast, 1), &right)) {
+        emit_push_temp(j);
+        compile_expr(j, get_child(ast, 1));
+        emit_rm(j, 0, 0x8B, RCX, reg_operand(RAX)); // mov ecx, eax
+        emit_pop_temp(j, RAX);
+        right = reg_operand(RCX);
+    }
+    return right;
+}
+
+// op eax, operando, para as operações com formas /r e imm32.
+static void emit_alu(Jit* j, int op_rm, int ext, Operand src) {
+    if (src.kind == OPD_IMM) {
+        emit_byte(j, 0x81);
+        emit_byte(j, 0xC0 | ext << 3 | RAX);
+        emit_dword(j, src.imm);
+    }
+    else {
+        emit_rm(j, 0, op_rm, RAX, src);
+    }
+}
+
+static int cond_code(NodeKind kind) {
+    switch (kind) {
+        case EQ_NODE:   return CC_E;
+        case NEQ_NODE:  return CC_NE;
+        case LT_NODE:   return CC_L;
+        case LE_NODE:   return CC_LE;
+        case GT_NODE:   return CC_G;
+        case GE_NODE:   return CC_GE;
+        default:        return -1;
+    }
+}
+
+static void compile_bin_op(Jit* j, AST* ast) {
+    Operand right = compile_operands(j, ast);
+    switch (get_kind(ast)) {
+        case PLUS_NODE:  emit_alu(j, 0x03, 0, right); break;
+        case MINUS_NODE: emit_alu(j, 0x2B, 5, right); break;
+        case TIMES_NODE:
+            if (right.kind == OPD_IMM) {
+                emit_byte(j, 0x69); emit_byte(j, 0xC0); emit_dword(j, right.imm); // imul eax, eax, imm
+            }
+            else {
+                emit_rm(j, 0, 0x0FAF, RAX, right);
+            }
+            break;
+        case OVER_NODE:
+            if (!(right.kind == OPD_REG && right.reg == RCX)) {
+                emit_load(j, RCX, right);
+            }
+            emit_byte(j, 0x99);                     // cdq
+            emit_byte(j, 0xF7); emit_byte(j, 0xF9); // idiv ecx
+            break;
+        case SHL_NODE:
+            if (right.kind == OPD_IMM) {
+                emit_byte(j, 0xC1); emit_byte(j, 0xE0); emit_byte(j, right.imm & 31); // shl eax, imm8
+            }
+            else {
+                if (!(right.kind == OPD_REG && right.reg == RCX)) {
+                    emit_load(j, RCX, right);
+                }
+                emit_byte(j, 0xD3); emit_byte(j, 0xE0); // shl eax, cl
+            }
+            break;
+        default: // comparação usada como valor
+            emit_alu(j, 0x3B, 7, right);
+            emit_byte(j, 0x0F); emit_byte(j, 0x90 | cond_code(get_kind(ast))); emit_byte(j, 0xC0); // setcc al
+            emit_byte(j, 0x0F); emit_byte(j, 0xB6); emit_byte(j, 0xC0);                            // movzx eax, al
+    }
+}
+
+// Endereço da célula 0 de um vetor local, relativo a rbp.
+static int array_disp(Jit* j, int var_idx) {
+    return j->cell_base + 8 * get_address(vt, var_idx);
+}
+
+// Carrega o índice de 'var_use' em rax, estendido para 64 bits.
+static void compile_index(Jit* j, AST* var_use) {
+    compile_expr(j, get_child(var_use, 0));
+    emit_byte(j, 0x48); emit_byte(j, 0x63); emit_byte(j, 0xC0); // movsxd rax, eax
+}
+
+static void compile_var_use(Jit* j, AST* ast) {
+    int var_idx = get_data(ast);
+    int size = get_size(vt, var_idx);
+
+    if (get_child_count(ast) == 1) {
+        AST* index = get_child(ast, 0);
+        if (size != -1 && get_kind(index) == INT_VAL_NODE) {
+            emit_load(j, RAX, mem_operand(array_disp(j, var_idx) + 8 * get_data(index)));
+        }
+        else if (size != -1) {
+            compile_index(j, ast);
+            emit_indexed(j, 0, 0x8B, RAX, RBP, RAX, array_disp(j, var_idx));
+        }
+        else {
+            compile_index(j, ast);
+            emit_rm(j, 1, 0x8B, RCX, var_operand(j, var_idx)); // mov rcx, [base do vetor]
+            emit_indexed(j, 0, 0x8B, RAX, RCX, RAX, 0);
+        }
+    }
+    else if (size == -1) {
+        // Referência repassada adiante: a célula do parâmetro guarda o ponteiro.
+        emit_rm(j, 1, 0x8B, RAX, var_operand(j, var_idx));
+    }
+    else if (size != 0) {
+        // Vetor local usado sem índice: passagem por referência.
+        emit_rm(j, 1, 0x8D, RAX, mem_operand(array_disp(j, var_idx))); // lea rax, [...]
+    }
+    else {
+        emit_load(j, RAX, var_operand(j, var_idx));
+    }
+}
+
+// Avalia os argumentos e os coloca nos registradores da convenção. Todos
+// são empilhados antes porque um argumento pode conter outra chamada.
+static void compile_args(Jit* j, AST* arg_list) {
+    int n = get_child_count(arg_list);
+    for (int i = 0; i < n; i++) {
+        AST* arg = get_child(arg_list, i);
+        if (get_kind(arg) == VAR_USE_NODE && get_child_count(arg) == 0 && get_size(vt, get_data(arg)) != 0) {
+            compile_var_use(j, arg); // ponteiro para o vetor
+        }
+        else {
+            compile_expr(j, arg);
+        }
+        emit_push_temp(j);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        emit_pop_temp(j, arg_regs[i]);
+    }
+}
+
+static void add_call_patch(Jit* j, int at, int func_id) {
+    if (j->patch_count == j->patch_capacity) {
+        j->patch_capacity = j->patch_capacity == 0 ? 64 : 2 * j->patch_capacity;
+        j->patches = realloc(j->patches, j->patch_capacity * sizeof(CallPatch));
+    }
+    j->patches[j->patch_count].at = at;
+    j->patches[j->patch_count].func_id = func_id;
+    j->patch_count++;
+}
+
+// Pilha sombra do --profile (ver profile.h), mantida nos pontos de chamada.
+// Só usam rax e r11: lá os argumentos já estão nos registradores e, depois
+// da chamada, emit_profile_leave não toca no resultado em eax.
+static void emit_profile_enter(Jit* j, int func_id) {
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) &shadow_stack);
+    emit_byte(j, 0x41); emit_byte(j, 0x8B); emit_byte(j, 0x03);    // mov eax, [r11]
+    emit_byte(j, 0x3D); emit_dword(j, PROFILE_MAX_DEPTH);           // cmp eax, imm32
+    int full = emit_jcc(j, 0x3);                                    // jae full
+    emit_byte(j, 0x41); emit_byte(j, 0xC7); emit_byte(j, 0x44);     // mov dword [r11 + rax*4 + 4], imm32
+    emit_byte(j, 0x83); emit_byte(j, 0x04); emit_dword(j, func_id);
+    patch_rel32(j, full, j->size);
+    emit_byte(j, 0x41); emit_byte(j, 0xFF); emit_byte(j, 0x03);    // inc dword [r11]
+}
+
+// Chamada em cauda: a função chamada toma o lugar do topo.
+static void emit_profile_replace(Jit* j, int func_id) {
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) &shadow_stack);
+    emit_byte(j, 0x41); emit_byte(j, 0x8B); emit_byte(j, 0x03);    // mov eax, [r11]
+    emit_byte(j, 0x3D); emit_dword(j, PROFILE_MAX_DEPTH);           // cmp eax, imm32
+    int full = emit_jcc(j, 0x7);                                    // ja full
+    emit_byte(j, 0x41); emit_byte(j, 0xC7); emit_byte(j, 0x04);     // mov dword [r11 + rax*4], imm32
+    emit_byte(j, 0x83); emit_dword(j, func_id);
+    patch_rel32(j, full, j->size);
+}
+
+static void emit_profile_leave(Jit* j) {
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) &shadow_stack);
+    emit_byte(j, 0x41); emit_byte(j, 0xFF); emit_byte(j, 0x0B);    // dec dword [r11]
+}
+
+// --stats: o JIT só conta chamadas, com um contador de 64 bits por função.
+static void emit_count_call(Jit* j, int func_id) {
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) &run_stats.calls[func_id]);
+    emit_byte(j, 0x49); emit_byte(j, 0xFF); emit_byte(j, 0x03);    // inc qword [r11]
+}
+
+static void compile_fcall(Jit* j, AST* ast) {
+    compile_args(j, get_child(ast, 0));
+    if (stats_enabled) {
+        emit_count_call(j, get_data(ast));
+    }
+    if (profiling) {
+        emit_profile_enter(j, get_data(ast));
+    }
+    int pad = j->depth % 2;
+    if (pad) {
+        emit_byte(j, 0x48); emit_byte(j, 0x83); emit_byte(j, 0xEC); emit_byte(j, 8); // sub rsp, 8
+    }
+    add_call_patch(j, emit_jump(j, 0xE8), get_data(ast));
+    if (pad) {
+        emit_byte(j, 0x48); emit_byte(j, 0x83); emit_byte(j, 0xC4); emit_byte(j, 8); // add rsp, 8
+    }
+    if (profiling) {
+        emit_profile_leave(j);
+    }
+}
+
+static void compile_expr(Jit* j, AST* ast) {
+    switch (get_kind(ast)) {
+        case INT_VAL_NODE:          emit_load(j, RAX, imm_operand(get_data(ast))); break;
+        case VAR_USE_NODE:
+            if (get_child_count(ast) == 0 && get_size(vt, get_data(ast)) != 0) {
+                // Vetor usado como número: nas outras máquinas isso dá o endereço
+                // numa memória de células, que não existe aqui.
+                j->unsupported = "array used as a value";
+            }
+            compile_var_use(j, ast);
+            break;
+        case FUNCTION_CALL_NODE:    compile_fcall(j, ast);                         break;
+        case INPUT_NODE:            emit_call_helper(j, jit_input);                break;
+        case INLINE_NODE:
+            compile_stmt(j, get_child(ast, 0));
+            compile_expr(j, get_child(ast, 1));
+            break;
+        default:                    compile_bin_op(j, ast);                        break;
+    }
+}
+
+// Statements -------------------------------------------------------------------
+
+// Desvia quando 'test' tem o valor 'when' e devolve a posição do rel32.
+static int compile_cond(Jit* j, AST* test, int when) {
+    int cc = cond_code(get_kind(test));
+    if (cc != -1) {
+        Operand right = compile_operands(j, test);
+        emit_alu(j, 0x3B, 7, right);
+    }
+    else {
+        compile_expr(j, test);
+        emit_byte(j, 0x85); emit_byte(j, 0xC0); // test eax, eax
+        cc = CC_NE;
+    }
+    return emit_jcc(j, when ? cc : cc ^ 1);
+}
+
+// Desfaz o registro de ativação, deixando rsp no endereço de retorno.
+static void emit_leave(Jit* j) {
+    emit_byte(j, 0x41); emit_byte(j, 0xFF); emit_byte(j, 0xC7); // inc r15d
+    if (j->reg_count > 0) {
+        emit_rm(j, 1, 0x8D, RSP, mem_operand(-8 * j->reg_count)); // lea rsp, [rbp - 8k]
+        for (int i = j->reg_count - 1; i >= 0; i--) {
+            emit_pop(j, var_regs[i]);
+        }
+    }
+    else {
+        emit_byte(j, 0x48); emit_byte(j, 0x89); emit_byte(j, 0xEC); // mov rsp, rbp
+    }
+    emit_pop(j, RBP);
+}
+
+static void compile_assign(Jit* j, AST* ast) {
+    AST* lval = get_child(ast, 0);
+    int var_idx = get_data(lval);
+    int size = get_size(vt, var_idx);
+
+    compile_expr(j, get_child(ast, 1));
+    if (get_child_count(lval) == 0) {
+        emit_rm(j, 0, 0x89, RAX, var_operand(j, var_idx)); // mov var, eax
+        return;
+    }
+    AST* index = get_child(lval, 0);
+    if (size != -1 && get_kind(index) == INT_VAL_NODE) {
+        emit_rm(j, 0, 0x89, RAX, mem_operand(array_disp(j, var_idx) + 8 * get_data(index)));
+        return;
+    }
+    // Como na VM, o valor é calculado antes do índice.
+    emit_push_temp(j);
+    compile_index(j, lval);
+    emit_pop_temp(j, RCX);
+    if (size != -1) {
+        emit_indexed(j, 0, 0x89, RCX, RBP, RAX, array_disp(j, var_idx));
+    }
+    else {
+        emit_rm(j, 1, 0x8B, RDX, var_operand(j, var_idx)); // mov rdx, [base do vetor]
+        emit_indexed(j, 0, 0x89, RCX, RDX, RAX, 0);
+    }
+}
+
+static void compile_if(Jit* j, AST* ast) {
+    int skip = compile_cond(j, get_child(ast, 0), 0);
+    compile_stmt(j, get_child(ast, 1));
+    if (get_child_count(ast) == 3) {
+        int end = emit_jump(j, 0xE9);
+        patch_rel32(j, skip, j->size);
+        compile_stmt(j, get_child(ast, 2));
+        patch_rel32(j, end, j->size);
+    }
+    else {
+        patch_rel32(j, skip, j->size);
+    }
+}
+
+// O teste fica no fim do laço, assim cada volta tem um só desvio.
+static void compile_while(Jit* j, AST* ast) {
+    int to_test = emit_jump(j, 0xE9);
+    int body = j->size;
+    compile_stmt(j, get_child(ast, 1));
+    patch_rel32(j, to_test, j->size);
+    patch_rel32(j, compile_cond(j, get_child(ast, 0), 1), body);
+}
+
+static void compile_return(Jit* j, AST* ast) {
+    if (get_child_count(ast) == 1 && get_kind(get_child(ast, 0)) == TAIL_CALL_NODE) {
+        // A função chamada reaproveita o lugar do registro corrente.
+        AST* call = get_child(ast, 0);
+        compile_args(j, get_child(call, 0));
+        if (stats_enabled) {
+            emit_count_call(j, get_data(call));
+        }
+        if (profiling) {
+            emit_profile_replace(j, get_data(call));
+        }
+        emit_leave(j);
+        add_call_patch(j, emit_jump(j, 0xE9), get_data(call));
+        return;
+    }
+    if (get_child_count(ast) == 1) {
+        compile_expr(j, get_child(ast, 0));
+    }
+    else {
+        emit_byte(j, 0x31); emit_byte(j, 0xC0); // xor eax, eax
+    }
+    emit_leave(j);
+    emit_byte(j, 0xC3); // ret
+}
+
+static void compile_stmt(Jit* j, AST* ast) {
+    switch (get_kind(ast)) {
+        case BLOCK_NODE:
+            for (int i = 0; i < get_child_count(ast); i++) {
+                compile_stmt(j, get_child(ast, i));
+            }
+            break;
+
+        case ASSIGN_NODE:           compile_assign(j, ast);     break;
+        case IF_NODE:               compile_if(j, ast);         break;
+        case WHILE_NODE:            compile_while(j, ast);      break;
+        case RETURN_NODE:           compile_return(j, ast);     break;
+        case FUNCTION_CALL_NODE:    compile_fcall(j, ast);      break;
+
+        case OUTPUT_NODE:
+            compile_expr(j, get_child(ast, 0));
+            emit_rm(j, 0, 0x8B, RDI, reg_operand(RAX)); // mov edi, eax
+            emit_call_helper(j, jit_output);
+            break;
+
+        case WRITE_NODE:
+            emit_mov_imm64(j, RDI, (uint64_t) (uintptr_t) get_string(st, get_data(get_child(ast, 0))));
+            emit_call_helper(j, jit_write);
+            break;
+
+        default:
+            fprintf(stderr, "Cannot compile kind: %s!\n", kind2str(get_kind(ast)));
+            exit(EXIT_FAILURE);
+    }
+}
+
+// Functions --------------------------------------------------------------------
+
+// Variáveis locais começam zeradas, como nos outros motores: as células do
+// registro e os registradores que ainda guardam valores do chamador. Os
+// parâmetros (as primeiras células) são escritos logo depois e ficam de fora.
+static void emit_zero_locals(Jit* j, int cells, AST* param_list) {
+    int first = get_child_count(param_list);
+    int locals = cells - first;
+    if (locals > 0) {
+        emit_byte(j, 0x31); emit_byte(j, 0xC0); // xor eax, eax
+    }
+    if (locals <= 8) {
+        for (int i = first; i < cells; i++) {
+            emit_rm(j, 1, 0x89, RAX, mem_operand(j->cell_base + 8 * i)); // mov [célula], rax
+        }
+    }
+    else {
+        emit_load(j, R11, imm_operand(locals));
+        int loop = j->size;
+        emit_indexed(j, 1, 0x89, RAX, RBP, R11, j->cell_base + 8 * (first - 1)); // mov [rbp + r11 * 8 + ...], rax
+        emit_byte(j, 0x49); emit_byte(j, 0xFF); emit_byte(j, 0xCB); // dec r11
+        patch_rel32(j, emit_jcc(j, CC_NE), loop);
+    }
+    for (int i = 0; i < j->reg_count; i++) {
+        int is_param = 0;
+        for (int k = 0; k < get_child_count(param_list); k++) {
+            is_param |= get_data(get_child(param_list, k)) == j->reg_var[i];
+        }
+        if (!is_param) {
+            emit_rm(j, 0, 0x31, var_regs[i], reg_operand(var_regs[i])); // xor reg, reg
+        }
+    }
+}
+
+static void compile_func_decl(Jit* j, AST* ast) {
+    AST* func_header = get_child(ast, 0);
+    AST* func_body = get_child(ast, 1);
+    AST* param_list = get_child(func_header, 1);
+    int func_id = get_data(get_child(func_header, 0));
+    int cells = get_frame_size(vt, get_func_scope(ft, func_id));
+
+    j->entry[func_id] = j->size;
+    j->depth = 0;
+    assign_registers(j, func_body);
+
+    // Na entrada rsp está 8 bytes fora do alinhamento de 16 (endereço de
+    // retorno); rbp, os registradores salvos e as células completam o resto.
+    int pad = (8 * j->reg_count + 8 * cells) % 16;
+    j->cell_base = -(8 * j->reg_count + 8 * cells + pad);
+
+    emit_push(j, RBP);
+    emit_byte(j, 0x48); emit_byte(j, 0x89); emit_byte(j, 0xE5); // mov rbp, rsp
+    for (int i = 0; i < j->reg_count; i++) {
+        emit_push(j, var_regs[i]);
+    }
+    if (8 * cells + pad > 0) {
+        emit_byte(j, 0x48); emit_byte(j, 0x81); emit_byte(j, 0xEC); // sub rsp, imm32
+        emit_dword(j, 8 * cells + pad);
+    }
+
+    // cmp rsp, [jit_stack_limit]; jb overflow
+    emit_mov_imm64(j, R11, (uint64_t) (uintptr_t) &jit_stack_limit);
+    emit_byte(j, 0x49); emit_byte(j, 0x3B); emit_byte(j, 0x23);
+    patch_rel32(j, emit_jcc(j, 0x2), j->overflow_stub);
+    // dec r15d; js call_overflow
+    emit_byte(j, 0x41); emit_byte(j, 0xFF); emit_byte(j, 0xCF);
+    patch_rel32(j, emit_jcc(j, 0x8), j->call_overflow_stub);
+
+    emit_zero_locals(j, cells, param_list);
+    for (int i = 0; i < get_child_count(param_list); i++) {
+        int var_idx = get_data(get_child(param_list, i));
+        // Parâmetros vetor guardam o ponteiro inteiro.
+        emit_rm(j, get_size(vt, var_idx) == -1, 0x89, arg_regs[i], var_operand(j, var_idx));
+    }
+
+    compile_stmt(j, get_child(func_body, 1));
+
+    // Função que termina sem return devolve 0.
+    emit_byte(j, 0x31); emit_byte(j, 0xC0); // xor eax, eax
+    emit_leave(j);
+    emit_byte(j, 0xC3);
+}
+
+// Entry ----------------------------------------------------------------------
+
+struct jit_code {
+    unsigned char* code;
+    size_t size;
+    int main_id;
+    int main_entry;
+    char* stack;
+};
+
+// int enter(char* stack_top, void* fn): roda fn na pilha do JIT, com o
+// limite de chamadas inteiro em r15 (que é do chamador, então é salvo).
+static void emit_enter_stub(Jit* j) {
+    emit_push(j, RBP);
+    emit_byte(j, 0x48); emit_byte(j, 0x89); emit_byte(j, 0xE5); // mov rbp, rsp
+    emit_push(j, CALL_BUDGET);
+    emit_load(j, CALL_BUDGET, imm_operand(VM_CALL_STACK_SIZE));
+    emit_byte(j, 0x48); emit_byte(j, 0x89); emit_byte(j, 0xFC); // mov rsp, rdi
+    emit_byte(j, 0xFF); emit_byte(j, 0xD6);                     // call rsi
+    emit_rm(j, 1, 0x8D, RSP, mem_operand(-8));                  // lea rsp, [rbp - 8]
+    emit_pop(j, CALL_BUDGET);
+    emit_pop(j, RBP);
+    emit_byte(j, 0xC3);
+}
+
+// Chega aqui com r11 = &jit_stack_limit. rsp pode estar bem abaixo do limite
+// (um registro grande), então volta para a margem antes de chamar o helper.
+// Devolve a posição do stub.
+static int emit_overflow_stub(Jit* j, void* helper) {
+    int at = j->size;
+    emit_byte(j, 0x49); emit_byte(j, 0x8B); emit_byte(j, 0x23);                     // mov rsp, [r11]
+    emit_byte(j, 0x48); emit_byte(j, 0x83); emit_byte(j, 0xE4); emit_byte(j, 0xF0); // and rsp, -16
+    j->depth = 0;
+    emit_call_helper(j, helper);
+    return at;
+}
+
+JitCode* jit_compile(AST* ast) {
+    int main_id = lookup_func(ft, find_string(ids, "main"));
+    if (main_id == -1) {
+        fprintf(stderr, "jit: main not found\n");
+        return NULL;
+    }
+    int func_count = get_child_count(ast);
+    for (int i = 0; i < func_count; i++) {
+        AST* func_header = get_child(get_child(ast, i), 0);
+        if (get_child_count(get_child(func_header, 1)) > MAX_REG_ARGS) {
+            fprintf(stderr, "jit: function '%s' has more than %d parameters\n",
+                    get_func_name(ft, get_data(get_child(func_header, 0))), MAX_REG_ARGS);
+            return NULL;
+        }
+    }
+
+    Jit j;
+    memset(&j, 0, sizeof j);
+    j.entry = malloc(func_count * sizeof(int));
+    emit_enter_stub(&j);
+    j.overflow_stub = emit_overflow_stub(&j, jit_stack_overflow);
+    j.call_overflow_stub = emit_overflow_stub(&j, jit_call_overflow);
+    for (int i = 0; i < func_count; i++) {
+        compile_func_decl(&j, get_child(ast, i));
+    }
+    if (j.unsupported != NULL) {
+        fprintf(stderr, "jit: %s\n", j.unsupported);
+        free(j.code);
+        free(j.entry);
+        free(j.patches);
+        return NULL;
+    }
+    for (int i = 0; i < j.patch_count; i++) {
+        patch_rel32(&j, j.patches[i].at, j.entry[j.patches[i].func_id]);
+    }
+
+    JitCode* jc = malloc(sizeof * jc);
+    jc->size = j.size;
+    jc->main_id = main_id;
+    jc->main_entry = j.entry[main_id];
+    jc->code = mmap(NULL, jc->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    jc->stack = mmap(NULL, JIT_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (jc->code == MAP_FAILED || jc->stack == MAP_FAILED) {
+        perror("jit: mmap");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(jc->code, j.code, j.size);
+    if (mprotect(jc->code, jc->size, PROT_READ | PROT_EXEC) == -1) {
+        perror("jit: mprotect");
+        exit(EXIT_FAILURE);
+    }
+    free(j.code);
+    free(j.entry);
+    free(j.patches);
+    return jc;
+}
+
+void jit_run(JitCode* jc) {
+    int (*enter)(char*, void*) = (int (*)(char*, void*)) (void*) jc->code;
+    jit_stack_limit = jc->stack + JIT_STACK_MARGIN;
+    if (stats_enabled) {
+        run_stats.calls[jc->main_id]++;
+    }
+    if (profiling) {
+        profile_enter(jc->main_id);
+    }
+    enter(jc->stack + JIT_STACK_SIZE, jc->code + jc->main_entry);
+    if (profiling) {
+        profile_leave();
+    }
+}
+
+void jit_free(JitCode* jc) {
+    munmap(jc->code, jc->size);
+    munmap(jc->stack, JIT_STACK_SIZE);
+    free(jc);
+}
+
+#else // !__x86_64__
+
+struct jit_code {
+    int unused;
+};
+
+JitCode* jit_compile(AST* ast) {
+    fprintf(stderr, "jit: only available on x86-64\n");
+    return NULL;
+}
+
+void jit_run(JitCode* jc) {
+}
+
+void jit_free(JitCode* jc) {
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "ast.h"
+
+// Native code for x86-64 (System V), generated straight from the AST.
+// ----------------------------------------------------------------------------
+
+// Opaque structure: the executable code of every function plus the stack
+// the generated code runs on.
+struct jit_code;
+typedef struct jit_code JitCode;
+
+// Translates every function of a checked AST (the FUNC_LIST_NODE root) to
+// machine code. Returns NULL, with the reason on stderr, when the program
+// uses something the JIT doesn't handle, so the caller can fall back to
+// run_ast.
+JitCode* jit_compile(AST* ast);
+
+// Runs main.
+void jit_run(JitCode* jc);
+
+void jit_free(JitCode* jc);
+
+#endif // JIT_H
@@ -0,0 +1,340 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "types.h"
+#include "tables.h"
+#include "ast.h"
+#include "interpreter.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "cgen.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "compilation.h"
+#include "batch.h"
+
+// Runtime input --------------------------------------------------------------
+
+// input() sempre lê de stdin; aqui só se escolhe o que fica por trás dele.
+static void redirect_input(int fd) {
+    if (fd != STDIN_FILENO && dup2(fd, STDIN_FILENO) == -1) {
+        perror("dup2");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Intervalo padrão entre duas amostras do --profile, em microssegundos de CPU.
+#define DEFAULT_PROFILE_INTERVAL 1000
+
+static void usage(char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] [program.cm]\n"
+            "  --ast             run on the AST walker instead of the bytecode VM\n"
+            "  --jit             compile to x86-64 machine code and run it\n"
+            "  -O0, -O1          optimization level (default -O0)\n"
+            "  --inline-budget N inline leaf functions of at most N nodes at -O1 (default %d, 0 = off)\n"
+            "  --opt-report      print what the optimizations did to stderr\n"
+            "                    (with --ast, also the statement fusion counters)\n"
+            "  --check-only      stop after parsing and checking the program\n"
+            "  --dir DIR         compile every .cm file in DIR to bytecode (or, with\n"
+            "                    --check-only, just check it) on a pool of threads and\n"
+            "                    print one line per file: ok or its first error; only\n"
+            "                    -O0/-O1, --inline-budget, --check-only and --jobs apply\n"
+            "  --jobs N          threads for --dir (default: one per core)\n"
+            "  --emit-c FILE     write the program as C source to FILE instead of running it\n"
+            "  -o EXE            compile the program to the executable EXE with gcc -O2\n"
+            "  --input FILE      read input() values from FILE (default: stdin)\n"
+            "  --input-fd N      read input() values from file descriptor N\n"
+            "  --batch           read input() values in bulk, without the prompt;\n"
+            "                    running out of input is an error\n"
+            "  --line-buffered   write the program's output at every line break\n"
+            "                    (the default when stdout is a terminal)\n"
+            "  --profile FILE    sample the C-minus call stack while running; write folded\n"
+            "                    stacks (for flame graphs) to FILE and a per-function\n"
+            "                    table to stderr at exit\n"
+            "  --profile-interval US  microseconds of CPU time between samples (default %d)\n"
+            "  --stats FILE      write run statistics (steps, calls, stack and memory\n"
+            "                    high-water marks, I/O bytes, phase times) to FILE as JSON\n"
+            "  --trace FILE      record every step of the AST walker or the VM (kind,\n"
+            "                    function, stack depth and top) in a ring buffer mapped\n"
+            "                    to FILE; read it with tracedump, even after a crash\n"
+            "  --trace-size N    keep the last N steps (default %d)\n"
+            "Without program.cm the program is read from stdin and input()\n"
+            "reads from the controlling terminal.\n", argv0, DEFAULT_INLINE_BUDGET, DEFAULT_PROFILE_INTERVAL,
+            TRACE_DEFAULT_EVENTS);
+    exit(EXIT_FAILURE);
+}
+
+// Main -----------------------------------------------------------------------
+
+// Por padrão o programa é compilado para bytecode e executado na VM.
+// Com --ast ele é executado diretamente sobre a árvore (útil para testes diferenciais).
+// Com --jit ele vira código de máquina; se o JIT não der conta do programa,
+// a árvore é executada no lugar.
+// -O1 liga as otimizações sobre a AST (inlining, laços e dobra de constantes) e
+// --opt-report imprime o que elas fizeram.
+// Com --dir, todos os arquivos de um diretório são compilados em paralelo,
+// cada um na sua Compilation, e nenhum é executado (ver batch.h).
+int main(int argc, char* argv[]) {
+    int use_ast = 0;
+    int use_jit = 0;
+    int opt_level = 0;
+    int opt_report = 0;
+    int inline_budget = DEFAULT_INLINE_BUDGET;
+    int line_buffered = isatty(STDOUT_FILENO);
+    int batch = 0;
+    int check_only = 0;
+    char* profile_path = NULL;
+    int profile_interval = DEFAULT_PROFILE_INTERVAL;
+    char* stats_path = NULL;
+    char* trace_path = NULL;
+    int trace_events = TRACE_DEFAULT_EVENTS;
+    char* program = NULL;
+    char* input_path = NULL;
+    int input_fd = -1;
+    char* c_path = NULL;
+    char* exe_path = NULL;
+    char* dir = NULL;
+    int jobs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ast") == 0) {
+            use_ast = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0) {
+            use_jit = 1;
+        }
+        else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0) {
+            opt_level = argv[i][2] - '0';
+        }
+        else if (strcmp(argv[i], "--opt-report") == 0) {
+            opt_report = 1;
+        }
+        else if (strcmp(argv[i], "--inline-budget") == 0 && i + 1 < argc) {
+            char* end;
+            inline_budget = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || inline_budget < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--check-only") == 0) {
+            check_only = 1;
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            char* end;
+            jobs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || jobs <= 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-interval") == 0 && i + 1 < argc) {
+            char* end;
+            profile_interval = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || profile_interval <= 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        }
+        else if (strncmp(argv[i], "--stats=", 8) == 0 && argv[i][8] != '\0') {
+            stats_path = argv[i] + 8;
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace-size") == 0 && i + 1 < argc) {
+            char* end;
+            trace_events = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || trace_events <= 0 || trace_events > (1 << 30)) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--line-buffered") == 0) {
+            line_buffered = 1;
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc) {
+            c_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            exe_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--input-fd") == 0 && i + 1 < argc) {
+            char* end;
+            input_fd = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || input_fd < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (argv[i][0] != '-' && program == NULL) {
+            program = argv[i];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+
+    if (dir != NULL) {
+        if (program != NULL || use_ast || use_jit || opt_report || c_path != NULL || exe_path != NULL
+            || input_path != NULL || input_fd != -1 || batch
+            || profile_path != NULL || stats_path != NULL || trace_path != NULL) {
+            fprintf(stderr, "--dir compiles the files it finds and runs none of them; it takes no program\n"
+                            "and can't be used with --ast, --jit, --opt-report, --emit-c, -o, --input,\n"
+                            "--input-fd, --batch, --profile, --stats or --trace.\n");
+            return EXIT_FAILURE;
+        }
+        BatchOptions options = { jobs, check_only, opt_level, inline_budget };
+        return compile_dir(dir, &options) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (stats_path != NULL) {
+        stats_start(stats_path);
+    }
+    stats_begin(PHASE_PARSE);
+
+    Compilation* c = create_compilation();
+    int status = program != NULL ? parse_file(c, program) : parse_program(c, NULL, 0, stdin);
+    stats_end(PHASE_PARSE);
+    if (status == -1) {
+        fprintf(stderr, "%s\n", c->error);
+        exit(EXIT_FAILURE);
+    }
+    if (status != 0) {
+        printf("%s\n", c->error);
+        exit(EXIT_FAILURE);
+    }
+    AST* root = c->root;
+    stats_program(ft);
+    if (check_only) {
+        stats_engine("none");
+        free_compilation(c);
+        return EXIT_SUCCESS;
+    }
+    //printf("PARSE SUCCESSFUL!\n");
+
+    //printf("\n\n");
+    //print_str_table(st); printf("\n\n");
+    //print_var_table(vt); printf("\n\n");
+    //print_func_table(ft); printf("\n\n");
+
+    //print_dot(root);
+
+    stats_begin(PHASE_OPTIMIZE);
+    optimize(root, opt_level, inline_budget, opt_report ? stderr : NULL);
+    stats_end(PHASE_OPTIMIZE);
+
+    // Backend AOT: gera o código e termina sem executar o programa.
+    if (c_path != NULL || exe_path != NULL) {
+        if (profile_path != NULL || trace_path != NULL) {
+            fprintf(stderr, "--profile and --trace need the program to run here; they can't be used with --emit-c or -o.\n");
+            return EXIT_FAILURE;
+        }
+        stats_engine("c");
+        stats_begin(PHASE_COMPILE);
+        int status = 0;
+        if (c_path != NULL) {
+            FILE* out = fopen(c_path, "w");
+            if (out == NULL) {
+                perror(c_path);
+                exit(EXIT_FAILURE);
+            }
+            status = emit_c(root, out);
+            fclose(out);
+        }
+        if (status == 0 && exe_path != NULL) {
+            status = compile_native(root, exe_path);
+        }
+        stats_end(PHASE_COMPILE);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (input_path != NULL) {
+        int fd = open(input_path, O_RDONLY);
+        if (fd == -1) {
+            perror(input_path);
+            exit(EXIT_FAILURE);
+        }
+        redirect_input(fd);
+        close(fd);
+    }
+    else if (input_fd != -1) {
+        redirect_input(input_fd);
+    }
+    else if (program == NULL) {
+        // O programa consumiu stdin; input() lê do terminal, como antes.
+        FILE* term = fopen(ctermid(NULL), "r");
+        if (term == NULL) {
+            fprintf(stderr, "No terminal for input(); pass the program as an argument or use --input.\n");
+            term = fopen("/dev/null", "r");
+        }
+        redirect_input(fileno(term));
+        fclose(term);
+    }
+    clearerr(stdin);
+    io_init(line_buffered, batch);
+    if (profile_path != NULL) {
+        // Antes de compilar: o JIT e o bytecode só instrumentam as funções com o profiler ligado.
+        profile_start(ft, profile_path, profile_interval);
+    }
+    if (trace_path != NULL) {
+        if (use_jit) {
+            fprintf(stderr, "--trace records AST nodes or VM instructions; it can't be used with --jit.\n");
+            return EXIT_FAILURE;
+        }
+        trace_start(trace_path, trace_events, ft, use_ast ? TRACE_AST : TRACE_VM);
+    }
+
+    stats_begin(PHASE_COMPILE);
+    JitCode* jc = use_jit ? jit_compile(root) : NULL;
+    stats_end(PHASE_COMPILE);
+    if (jc != NULL) {
+        stats_engine("jit");
+        stats_begin(PHASE_EXECUTE);
+        jit_run(jc);
+        stats_end(PHASE_EXECUTE);
+        jit_free(jc);
+    }
+    else if (use_ast || use_jit) {
+        stats_engine("ast");
+        counting_fusions = opt_report;
+        stats_begin(PHASE_EXECUTE);
+        run_ast(root);
+        stats_end(PHASE_EXECUTE);
+        if (opt_report) {
+            print_fusion_report(stderr);
+        }
+    }
+    else {
+        stats_begin(PHASE_COMPILE);
+        Bytecode* bc = compile_ast(root);
+        stats_end(PHASE_COMPILE);
+        //print_bytecode(bc);
+        stats_begin(PHASE_EXECUTE);
+        run_bytecode(bc);
+        stats_end(PHASE_EXECUTE);
+        free_bytecode(bc);
+    }
+
+    free_compilation(c);
+
+    return 0;
+}
@@ -0,0 +1,1008 @@
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "compilation.h"
+#include "optimizer.h"
+#include "tables.h"
+
+// Constant folding -----------------------------------------------------------
+
+// O estado das passadas é por thread: o --dir otimiza vários programas ao
+// mesmo tempo (ver batch.h).
+static _Thread_local FoldStats fold_stats;
+
+static int is_num(AST* ast, int val) {
+    return get_kind(ast) == INT_VAL_NODE && get_data(ast) == val;
+}
+
+static int is_const(AST* ast) {
+    return get_kind(ast) == INT_VAL_NODE;
+}
+
+// Retorna k se n == 2^k (k >= 1), senão 0.
+static int log2_exact(int n) {
+    if (n < 2 || (n & (n - 1)) != 0) {
+        return 0;
+    }
+    int k = 0;
+    while (n > 1) {
+        n >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// Uma expressão pode ser descartada se não chama funções, não lê a entrada e
+// não tem divisão que possa falhar: por algo que possa ser zero, ou por -1
+// (INT_MIN / -1 também para a execução, como em eval_bin_op).
+static int is_pure(AST* ast) {
+    switch (get_kind(ast)) {
+        case INPUT_NODE:
+        case FUNCTION_CALL_NODE:
+        case TAIL_CALL_NODE:
+        case INLINE_NODE:
+            return 0;
+        case OVER_NODE:
+            if (!is_const(get_child(ast, 1)) || get_data(get_child(ast, 1)) == 0
+                    || get_data(get_child(ast, 1)) == -1) {
+                return 0;
+            }
+            break;
+        default:
+            break;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (!is_pure(get_child(ast, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Calcula l op r como a VM faria, com aritmética módulo 2^32.
+// Divisões que falhariam em tempo de execução não são dobradas.
+static int eval_bin_op(NodeKind kind, int l, int r, int* val) {
+    switch (kind) {
+        case PLUS_NODE:  *val = (int) ((unsigned) l + (unsigned) r); return 1;
+        case MINUS_NODE: *val = (int) ((unsigned) l - (unsigned) r); return 1;
+        case TIMES_NODE: *val = (int) ((unsigned) l * (unsigned) r); return 1;
+        case SHL_NODE:   *val = (int) ((unsigned) l << r);           return 1;
+        case OVER_NODE:
+            if (r == 0 || (l == INT_MIN && r == -1)) {
+                return 0;
+            }
+            *val = l / r;
+            return 1;
+        case EQ_NODE:    *val = l == r; return 1;
+        case NEQ_NODE:   *val = l != r; return 1;
+        case LT_NODE:    *val = l < r;  return 1;
+        case LE_NODE:    *val = l <= r; return 1;
+        case GT_NODE:    *val = l > r;  return 1;
+        case GE_NODE:    *val = l >= r; return 1;
+        default:         return 0;
+    }
+}
+
+static AST* new_num(int val) {
+    return new_node(INT_VAL_NODE, val);
+}
+
+// Simplifica um operador binário cujos filhos já foram dobrados.
+static AST* simplify_bin_op(AST* ast) {
+    NodeKind kind = get_kind(ast);
+    AST* l = get_child(ast, 0);
+    AST* r = get_child(ast, 1);
+    int val;
+
+    if (is_const(l) && is_const(r) && eval_bin_op(kind, get_data(l), get_data(r), &val)) {
+        fold_stats.folded++;
+        return new_num(val);
+    }
+
+    switch (kind) {
+        case PLUS_NODE:
+        case MINUS_NODE:
+            if (is_num(r, 0)) {
+                fold_stats.identities++;
+                return l;
+            }
+            if (kind == PLUS_NODE && is_num(l, 0)) {
+                fold_stats.identities++;
+                return r;
+            }
+            // (x + c1) + c2 => x + (c1 + c2), e variações com '-'.
+            if (is_const(r) && (get_kind(l) == PLUS_NODE || get_kind(l) == MINUS_NODE)
+                    && is_const(get_child(l, 1))) {
+                unsigned c1 = get_data(get_child(l, 1));
+                unsigned c2 = get_data(r);
+                if (get_kind(l) == MINUS_NODE) {
+                    c1 = -c1;
+                }
+                if (kind == MINUS_NODE) {
+                    c2 = -c2;
+                }
+                fold_stats.folded++;
+                set_kind(l, PLUS_NODE);
+                set_child(l, 1, new_num((int) (c1 + c2)));
+                return simplify_bin_op(l);
+            }
+            break;
+
+        case TIMES_NODE:
+            if (is_num(r, 1)) {
+                fold_stats.identities++;
+                return l;
+            }
+            if (is_num(l, 1)) {
+                fold_stats.identities++;
+                return r;
+            }
+            if ((is_num(r, 0) && is_pure(l)) || (is_num(l, 0) && is_pure(r))) {
+                fold_stats.identities++;
+                return new_num(0);
+            }
+            if (is_const(l) && !is_const(r)) {
+                set_child(ast, 0, r);
+                set_child(ast, 1, l);
+                r = l;
+                l = get_child(ast, 0);
+            }
+            if (is_const(r) && log2_exact(get_data(r)) != 0) {
+                fold_stats.shifts++;
+                set_kind(ast, SHL_NODE);
+                set_child(ast, 1, new_num(log2_exact(get_data(r))));
+            }
+            break;
+
+        case OVER_NODE:
+            // x / 2^k não vira shift: com x negativo o resultado arredondaria para baixo.
+            if (is_num(r, 1)) {
+                fold_stats.identities++;
+                return l;
+            }
+            break;
+
+        default:
+            break;
+    }
+    return ast;
+}
+
+static AST* fold_node(AST* ast) {
+    for (int i = 0; i < get_child_count(ast); i++) {
+        set_child(ast, i, fold_node(get_child(ast, i)));
+    }
+
+    switch (get_kind(ast)) {
+        case PLUS_NODE:
+        case MINUS_NODE:
+        case TIMES_NODE:
+        case OVER_NODE:
+        case EQ_NODE:
+        case NEQ_NODE:
+        case LT_NODE:
+        case LE_NODE:
+        case GT_NODE:
+        case GE_NODE:
+            return simplify_bin_op(ast);
+
+        case IF_NODE:
+            if (is_const(get_child(ast, 0))) {
+                fold_stats.branches++;
+                if (get_data(get_child(ast, 0)) != 0) {
+                    return get_child(ast, 1);
+                }
+                return get_child_count(ast) == 3 ? get_child(ast, 2) : new_subtree(BLOCK_NODE, 0);
+            }
+            break;
+
+        case WHILE_NODE:
+            if (is_num(get_child(ast, 0), 0)) {
+                fold_stats.branches++;
+                return new_subtree(BLOCK_NODE, 0);
+            }
+            break;
+
+        default:
+            break;
+    }
+    return ast;
+}
+
+FoldStats fold_constants(AST* ast) {
+    FoldStats zero = { 0, 0, 0, 0 };
+    fold_stats = zero;
+    fold_node(ast);
+    return fold_stats;
+}
+
+// Inlining -------------------------------------------------------------------
+
+// Uma função pode ser expandida no lugar da chamada se é folha (não chama
+// ninguém, então também não é recursiva), não tem vetores locais e só tem
+// return como último comando do corpo. O corpo copiado vira um INLINE_NODE:
+// um bloco que atribui os argumentos e roda os comandos, seguido da
+// expressão do return, calculada no registro de ativação do chamador.
+
+typedef struct {
+    AST* decl;
+    int size;   // nós do corpo, ou -1 se a função não pode ser expandida
+    int sites;  // chamadas expandidas
+} Inlinee;
+
+static _Thread_local Inlinee* inlinees;
+static _Thread_local int inline_budget;
+static _Thread_local int inline_serial; // numera as expansões, para que os nomes não colidam
+
+// Variáveis da função expandida e as que as substituem no chamador.
+// Um parâmetro que recebe uma constante ou variável simples e nunca é
+// atribuído não precisa de cópia: seus usos viram o próprio argumento (value).
+typedef struct {
+    int from;
+    int to;
+    AST* value;
+} VarRename;
+
+typedef struct {
+    VarRename* t;
+    int size;
+} VarMap;
+
+static void map_var(VarMap* map, int from, int to, AST* value) {
+    map->t[map->size].from = from;
+    map->t[map->size].to = to;
+    map->t[map->size].value = value;
+    map->size++;
+}
+
+static VarRename* find_rename(VarMap* map, int from) {
+    for (int i = 0; i < map->size; i++) {
+        if (map->t[i].from == from) {
+            return &map->t[i];
+        }
+    }
+    return NULL;
+}
+
+static int count_nodes(AST* ast) {
+    int count = 1;
+    for (int i = 0; i < get_child_count(ast); i++) {
+        count += count_nodes(get_child(ast, i));
+    }
+    return count;
+}
+
+// Verdadeiro se o trecho não tem chamadas nem return.
+static int is_straight(AST* ast) {
+    NodeKind kind = get_kind(ast);
+    if (kind == FUNCTION_CALL_NODE || kind == TAIL_CALL_NODE || kind == RETURN_NODE) {
+        return 0;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (!is_straight(get_child(ast, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Tamanho do corpo da função, ou -1 se ela não pode ser expandida.
+static int inline_size(AST* func_decl) {
+    AST* func_body = get_child(func_decl, 1);
+    AST* var_list = get_child(func_body, 0);
+    AST* block = get_child(func_body, 1);
+    for (int i = 0; i < get_child_count(var_list); i++) {
+        if (get_size(vt, get_data(get_child(var_list, i))) > 0) {
+            return -1;
+        }
+    }
+    int n = get_child_count(block);
+    int size = 0;
+    for (int i = 0; i < n; i++) {
+        AST* stmt = get_child(block, i);
+        if (i == n - 1 && get_kind(stmt) == RETURN_NODE) {
+            if (get_child_count(stmt) == 1) {
+                if (!is_straight(get_child(stmt, 0))) {
+                    return -1;
+                }
+                size += count_nodes(get_child(stmt, 0));
+            }
+        }
+        else if (is_straight(stmt)) {
+            size += count_nodes(stmt);
+        }
+        else {
+            return -1;
+        }
+    }
+    return size;
+}
+
+static int uses_var(AST* ast, int var) {
+    if (get_kind(ast) == VAR_USE_NODE && get_data(ast) == var) {
+        return 1;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (uses_var(get_child(ast, i), var)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int assigns_var(AST* ast, int var) {
+    if (get_kind(ast) == ASSIGN_NODE && get_data(get_child(ast, 0)) == var) {
+        return 1;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (assigns_var(get_child(ast, i), var)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Verdadeiro se o primeiro comando do bloco que menciona 'var' é uma
+// atribuição a ela que não lê o valor antigo (então não precisa zerar).
+static int written_first(AST* block, int var) {
+    for (int i = 0; i < get_child_count(block); i++) {
+        AST* stmt = get_child(block, i);
+        if (get_kind(stmt) == ASSIGN_NODE && get_data(get_child(stmt, 0)) == var
+                && get_child_count(get_child(stmt, 0)) == 0) {
+            return !uses_var(get_child(stmt, 1), var);
+        }
+        if (uses_var(stmt, var)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static AST* clone_tree(AST* ast, VarMap* map) {
+    int data = get_data(ast);
+    if (get_kind(ast) == VAR_USE_NODE) {
+        VarRename* r = map != NULL ? find_rename(map, data) : NULL;
+        if (r != NULL && r->value != NULL) {
+            return new_node(get_kind(r->value), get_data(r->value));
+        }
+        if (r != NULL) {
+            data = r->to;
+        }
+    }
+    AST* copy = new_node(get_kind(ast), data);
+    for (int i = 0; i < get_child_count(ast); i++) {
+        add_child(copy, clone_tree(get_child(ast, i), map));
+    }
+    return copy;
+}
+
+// Cria no escopo do chamador uma cópia renomeada da variável 'var' da função
+// 'callee' e a declara na lista de variáveis do chamador.
+static int new_local(int var, int callee, int scope, AST* caller_vars) {
+    char name[256];
+    // '_' não aparece em identificadores de C-Minus, então não há colisão.
+    snprintf(name, sizeof name, "%s_%s_%d", get_func_name(ft, callee), get_name(vt, var), inline_serial);
+    int copy = add_var(vt, add_string(ids, name), get_line(vt, var), scope, get_size(vt, var));
+    add_child(caller_vars, new_node(VAR_DECL_NODE, copy));
+    return copy;
+}
+
+// Monta o corpo expandido da chamada, ou devolve NULL se ela fica como está.
+// Como comando (as_stmt), a chamada vira só o bloco, e o valor é descartado.
+static AST* expand_call(AST* fcall, int scope, AST* caller_vars, int as_stmt) {
+    int callee = get_data(fcall);
+    Inlinee* in = &inlinees[callee];
+    AST* header = get_child(in->decl, 0);
+    AST* param_list = get_child(header, 1);
+    AST* func_body = get_child(in->decl, 1);
+    AST* var_list = get_child(func_body, 0);
+    AST* block = get_child(func_body, 1);
+    AST* arg_list = get_child(fcall, 0);
+
+    // Vetores são passados por referência: o corpo usa direto o vetor do
+    // chamador, que é sempre uma variável sem índice.
+    for (int i = 0; i < get_child_count(param_list); i++) {
+        AST* arg = get_child(arg_list, i);
+        if (get_size(vt, get_data(get_child(param_list, i))) == -1
+                && (get_kind(arg) != VAR_USE_NODE || get_child_count(arg) != 0
+                    || get_size(vt, get_data(arg)) == 0)) {
+            return NULL;
+        }
+    }
+    int n = get_child_count(block);
+    AST* ret = n > 0 && get_kind(get_child(block, n - 1)) == RETURN_NODE ? get_child(block, n - 1) : NULL;
+    AST* value = ret != NULL && get_child_count(ret) == 1 ? get_child(ret, 0) : NULL;
+    if (as_stmt && value != NULL && !is_pure(value)) {
+        return NULL;
+    }
+
+    inline_serial++;
+    VarMap map;
+    map.t = malloc((get_child_count(param_list) + get_child_count(var_list)) * sizeof(VarRename));
+    map.size = 0;
+    AST* body = new_subtree(BLOCK_NODE, 0);
+
+    // Os argumentos são avaliados em ordem, antes do corpo, como numa chamada.
+    for (int i = 0; i < get_child_count(param_list); i++) {
+        int param = get_data(get_child(param_list, i));
+        AST* arg = get_child(arg_list, i);
+        if (get_size(vt, param) == -1) {
+            map_var(&map, param, get_data(arg), NULL);
+        }
+        else if ((is_const(arg) || (get_kind(arg) == VAR_USE_NODE && get_child_count(arg) == 0
+                    && get_size(vt, get_data(arg)) == 0)) && !assigns_var(block, param)) {
+            // O corpo não altera variáveis simples do chamador, então o
+            // argumento vale o mesmo durante toda a expansão.
+            map_var(&map, param, -1, arg);
+        }
+        else {
+            int copy = new_local(param, callee, scope, caller_vars);
+            map_var(&map, param, copy, NULL);
+            add_child(body, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, copy), arg));
+        }
+    }
+    // Locais começam zeradas a cada expansão, como num registro novo, a não
+    // ser que o corpo as atribua antes de ler.
+    for (int i = 0; i < get_child_count(var_list); i++) {
+        int var = get_data(get_child(var_list, i));
+        int copy = new_local(var, callee, scope, caller_vars);
+        map_var(&map, var, copy, NULL);
+        if (!written_first(block, var)) {
+            add_child(body, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, copy), new_num(0)));
+        }
+    }
+    for (int i = 0; i < (ret != NULL ? n - 1 : n); i++) {
+        add_child(body, clone_tree(get_child(block, i), &map));
+    }
+
+    AST* result = body;
+    if (!as_stmt) {
+        result = new_subtree(INLINE_NODE, 2, body, value != NULL ? clone_tree(value, &map) : new_num(0));
+    }
+    free(map.t);
+    in->sites++;
+    return result;
+}
+
+// Expande as chamadas dentro de 'ast', de baixo para cima: os argumentos de
+// uma chamada já chegam expandidos ao corpo copiado.
+static void inline_node(AST* ast, int scope, AST* caller_vars) {
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* child = get_child(ast, i);
+        inline_node(child, scope, caller_vars);
+        if (get_kind(child) != FUNCTION_CALL_NODE) {
+            continue;
+        }
+        Inlinee* in = &inlinees[get_data(child)];
+        if (in->decl == NULL || in->size == -1 || in->size > inline_budget) {
+            continue;
+        }
+        AST* expanded = expand_call(child, scope, caller_vars, get_kind(ast) == BLOCK_NODE);
+        if (expanded != NULL) {
+            set_child(ast, i, expanded);
+        }
+    }
+}
+
+InlineStats inline_calls(AST* ast, int budget, FILE* report) {
+    InlineStats stats = { 0, 0 };
+    int count = get_child_count(ast);
+    inlinees = calloc(count, sizeof(Inlinee));
+    inline_budget = budget;
+    inline_serial = 0;
+
+    // As funções são declaradas antes de serem usadas, então cada uma já foi
+    // processada (e pode ter virado folha) quando aparece numa chamada.
+    for (int i = 0; i < count; i++) {
+        AST* func_decl = get_child(ast, i);
+        int func_id = get_data(get_child(get_child(func_decl, 0), 0));
+        AST* func_body = get_child(func_decl, 1);
+        inline_node(get_child(func_body, 1), get_func_scope(ft, func_id), get_child(func_body, 0));
+        inlinees[func_id].decl = func_decl;
+        inlinees[func_id].size = inline_size(func_decl);
+    }
+
+    for (int func_id = 0; func_id < count; func_id++) {
+        Inlinee* in = &inlinees[func_id];
+        if (in->sites > 0) {
+            stats.functions++;
+            stats.sites += in->sites;
+            if (report != NULL) {
+                fprintf(report, "inline: %s (%d nodes) at %d call site%s\n",
+                        get_func_name(ft, func_id), in->size, in->sites, in->sites > 1 ? "s" : "");
+            }
+        }
+    }
+    free(inlinees);
+    inlinees = NULL;
+    return stats;
+}
+
+// Loops ----------------------------------------------------------------------
+
+// Cada while é otimizado depois dos laços que ele contém. Um laço curto com
+// número de voltas conhecido é desenrolado; nos outros, produtos de variáveis
+// de indução viram somas acumuladas e expressões invariantes são calculadas
+// uma vez, em temporários atribuídos antes do laço.
+
+#define MAX_UNROLL_TRIPS 8
+#define MAX_UNROLL_NODES 128
+
+static _Thread_local LoopStats loop_stats;
+static _Thread_local int loop_scope;      // escopo da função corrente
+static _Thread_local AST* loop_vars;      // var_list da função corrente, onde entram os temporários
+static _Thread_local int loop_serial;
+
+// Temporário novo da função corrente. Como '_' não aparece em identificadores
+// de C-Minus, o nome não colide com as variáveis do programa.
+static int new_loop_temp(char kind) {
+    char name[32];
+    snprintf(name, sizeof name, "_%c%d", kind, ++loop_serial);
+    int var = add_var(vt, add_string(ids, name), 0, loop_scope, 0);
+    add_child(loop_vars, new_node(VAR_DECL_NODE, var));
+    return var;
+}
+
+typedef struct {
+    int* t;
+    int size;
+    int capacity;
+} VarSet;
+
+static void add_to_set(VarSet* s, int var) {
+    if (s->size == s->capacity) {
+        s->capacity = s->capacity == 0 ? 16 : 2 * s->capacity;
+        s->t = realloc(s->t, s->capacity * sizeof(int));
+    }
+    s->t[s->size++] = var;
+}
+
+static int in_set(VarSet* s, int var) {
+    for (int i = 0; i < s->size; i++) {
+        if (s->t[i] == var) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Variáveis simples atribuídas em algum ponto do trecho.
+static void collect_assigned(AST* ast, VarSet* s) {
+    if (get_kind(ast) == ASSIGN_NODE) {
+        AST* lval = get_child(ast, 0);
+        if (get_child_count(lval) == 0 && !in_set(s, get_data(lval))) {
+            add_to_set(s, get_data(lval));
+        }
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        collect_assigned(get_child(ast, i), s);
+    }
+}
+
+static int count_assigns(AST* ast, int var) {
+    int count = get_kind(ast) == ASSIGN_NODE && get_data(get_child(ast, 0)) == var
+                && get_child_count(get_child(ast, 0)) == 0;
+    for (int i = 0; i < get_child_count(ast); i++) {
+        count += count_assigns(get_child(ast, i), var);
+    }
+    return count;
+}
+
+static int is_scalar_var(AST* ast) {
+    return get_kind(ast) == VAR_USE_NODE && get_child_count(ast) == 0 && get_size(vt, get_data(ast)) == 0;
+}
+
+static int is_bin_op(NodeKind kind) {
+    switch (kind) {
+        case PLUS_NODE: case MINUS_NODE: case TIMES_NODE: case OVER_NODE: case SHL_NODE:
+        case EQ_NODE: case NEQ_NODE: case LT_NODE: case LE_NODE: case GT_NODE: case GE_NODE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int same_tree(AST* a, AST* b) {
+    if (get_kind(a) != get_kind(b) || get_data(a) != get_data(b)
+            || get_child_count(a) != get_child_count(b)) {
+        return 0;
+    }
+    for (int i = 0; i < get_child_count(a); i++) {
+        if (!same_tree(get_child(a, i), get_child(b, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 'i = i + c' ou 'i = i - c', com c constante não nula; devolve o passo.
+static int is_increment(AST* stmt, int* var, int* step) {
+    if (get_kind(stmt) != ASSIGN_NODE) {
+        return 0;
+    }
+    AST* lval = get_child(stmt, 0);
+    AST* rval = get_child(stmt, 1);
+    NodeKind kind = get_kind(rval);
+    if (!is_scalar_var(lval) || (kind != PLUS_NODE && kind != MINUS_NODE)) {
+        return 0;
+    }
+    AST* l = get_child(rval, 0);
+    AST* r = get_child(rval, 1);
+    if (!is_scalar_var(l) || get_data(l) != get_data(lval) || !is_const(r) || get_data(r) == 0) {
+        return 0;
+    }
+    *var = get_data(lval);
+    *step = kind == PLUS_NODE ? get_data(r) : (int) -(unsigned) get_data(r);
+    return 1;
+}
+
+// Unrolling ------------------------------------------------------------------
+
+// 'i = c0; while (i <op> c1) { ...; i = i + c; }', com i atribuída só no
+// último comando, vira as cópias do corpo com i trocada pelo valor de cada
+// volta, seguidas de 'i = <valor final>'.
+static AST* unroll(AST* loop, AST* init) {
+    if (init == NULL || get_kind(init) != ASSIGN_NODE
+            || !is_scalar_var(get_child(init, 0)) || !is_const(get_child(init, 1))) {
+        return NULL;
+    }
+    int var = get_data(get_child(init, 0));
+    AST* test = get_child(loop, 0);
+    AST* body = get_child(loop, 1);
+    if (!is_bin_op(get_kind(test)) || !is_scalar_var(get_child(test, 0))
+            || get_data(get_child(test, 0)) != var || !is_const(get_child(test, 1))
+            || get_kind(body) != BLOCK_NODE || get_child_count(body) == 0) {
+        return NULL;
+    }
+    int n = get_child_count(body);
+    int inc_var;
+    int step;
+    if (!is_increment(get_child(body, n - 1), &inc_var, &step) || inc_var != var
+            || count_assigns(body, var) != 1) {
+        return NULL;
+    }
+
+    // Conta as voltas simulando o teste.
+    int limit = get_data(get_child(test, 1));
+    int trips = 0;
+    int v = get_data(get_child(init, 1));
+    int go;
+    while (eval_bin_op(get_kind(test), v, limit, &go) && go) {
+        if (++trips > MAX_UNROLL_TRIPS) {
+            return NULL;
+        }
+        v = (int) ((unsigned) v + (unsigned) step);
+    }
+    if (trips * count_nodes(body) > MAX_UNROLL_NODES) {
+        return NULL;
+    }
+
+    AST* block = new_subtree(BLOCK_NODE, 0);
+    VarRename r;
+    VarMap map = { &r, 0 };
+    v = get_data(get_child(init, 1));
+    for (int t = 0; t < trips; t++) {
+        map.size = 0;
+        map_var(&map, var, -1, new_num(v));
+        for (int i = 0; i < n - 1; i++) {
+            add_child(block, clone_tree(get_child(body, i), &map));
+        }
+        v = (int) ((unsigned) v + (unsigned) step);
+    }
+    add_child(block, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, var), new_num(v)));
+    loop_stats.unrolled++;
+    return block;
+}
+
+// Strength reduction ---------------------------------------------------------
+
+// Um produto i * k, com i variável de indução (passo c) e k invariante, é
+// mantido num temporário s: 's = i * k' antes do laço e 's = s + c * k' logo
+// depois do incremento de i. A aritmética é módulo 2^32, então a igualdade
+// s == i * k vale em todo o laço.
+typedef struct {
+    int iv;     // variável de indução
+    int step;
+    int pos;    // posição do incremento no corpo
+} Induction;
+
+typedef struct {
+    Induction* iv;
+    AST* factor;
+    int temp;
+} Product;
+
+typedef struct {
+    Induction* ivs;
+    int iv_count;
+    Product* products;
+    int size;
+    int capacity;
+    VarSet* assigned;
+} Reduction;
+
+static int is_invariant_leaf(AST* ast, VarSet* assigned) {
+    return is_const(ast) || (is_scalar_var(ast) && !in_set(assigned, get_data(ast)));
+}
+
+static Induction* find_induction(Reduction* red, AST* ast) {
+    if (!is_scalar_var(ast)) {
+        return NULL;
+    }
+    for (int i = 0; i < red->iv_count; i++) {
+        if (red->ivs[i].iv == get_data(ast)) {
+            return &red->ivs[i];
+        }
+    }
+    return NULL;
+}
+
+static int product_temp(Reduction* red, Induction* iv, AST* factor) {
+    for (int i = 0; i < red->size; i++) {
+        if (red->products[i].iv == iv && same_tree(red->products[i].factor, factor)) {
+            return red->products[i].temp;
+        }
+    }
+    if (red->size == red->capacity) {
+        red->capacity = red->capacity == 0 ? 8 : 2 * red->capacity;
+        red->products = realloc(red->products, red->capacity * sizeof(Product));
+    }
+    Product* p = &red->products[red->size++];
+    p->iv = iv;
+    p->factor = factor;
+    p->temp = new_loop_temp('s');
+    loop_stats.reduced++;
+    return p->temp;
+}
+
+static void reduce_in(AST* ast, Reduction* red) {
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* child = get_child(ast, i);
+        if (get_kind(child) == TIMES_NODE) {
+            AST* l = get_child(child, 0);
+            AST* r = get_child(child, 1);
+            Induction* iv = find_induction(red, l);
+            AST* factor = r;
+            if (iv == NULL || !is_invariant_leaf(r, red->assigned)) {
+                iv = find_induction(red, r);
+                factor = l;
+            }
+            if (iv != NULL && is_invariant_leaf(factor, red->assigned)) {
+                set_child(ast, i, new_node(VAR_USE_NODE, product_temp(red, iv, factor)));
+                continue;
+            }
+        }
+        reduce_in(child, red);
+    }
+}
+
+static void reduce_strength(AST* loop, VarSet* assigned, AST* pre) {
+    AST* body = get_child(loop, 1);
+    if (get_kind(body) != BLOCK_NODE) {
+        return;
+    }
+    int n = get_child_count(body);
+    Reduction red = { malloc(n * sizeof(Induction)), 0, NULL, 0, 0, assigned };
+    for (int p = 0; p < n; p++) {
+        int var;
+        int step;
+        if (is_increment(get_child(body, p), &var, &step) && count_assigns(loop, var) == 1) {
+            red.ivs[red.iv_count].iv = var;
+            red.ivs[red.iv_count].step = step;
+            red.ivs[red.iv_count].pos = p;
+            red.iv_count++;
+        }
+    }
+    if (red.iv_count > 0) {
+        reduce_in(loop, &red);
+    }
+    if (red.size > 0) {
+        AST* reduced = new_subtree(BLOCK_NODE, 0);
+        for (int p = 0; p < n; p++) {
+            add_child(reduced, get_child(body, p));
+            for (int i = 0; i < red.size; i++) {
+                Product* prod = &red.products[i];
+                if (prod->iv->pos != p) {
+                    continue;
+                }
+                AST* delta = new_subtree(TIMES_NODE, 2, new_num(prod->iv->step), clone_tree(prod->factor, NULL));
+                add_child(reduced, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, prod->temp),
+                        new_subtree(PLUS_NODE, 2, new_node(VAR_USE_NODE, prod->temp), delta)));
+            }
+        }
+        set_child(loop, 1, reduced);
+        for (int i = 0; i < red.size; i++) {
+            Product* prod = &red.products[i];
+            add_child(pre, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, prod->temp),
+                    new_subtree(TIMES_NODE, 2, new_node(VAR_USE_NODE, prod->iv->iv), clone_tree(prod->factor, NULL))));
+            add_to_set(assigned, prod->temp);
+        }
+    }
+    free(red.ivs);
+    free(red.products);
+}
+
+// Hoisting -------------------------------------------------------------------
+
+// Expressão sem efeitos cujo valor não muda durante o laço: só constantes e
+// variáveis simples que o laço não atribui. Divisão só por constante (e não
+// por 0 nem -1), já que o cálculo passa a acontecer mesmo se o laço não rodar.
+static int is_invariant(AST* ast, VarSet* assigned) {
+    NodeKind kind = get_kind(ast);
+    if (kind == INT_VAL_NODE || kind == VAR_USE_NODE) {
+        return is_invariant_leaf(ast, assigned);
+    }
+    if (!is_bin_op(kind)) {
+        return 0;
+    }
+    if (kind == OVER_NODE) {
+        AST* d = get_child(ast, 1);
+        if (!is_const(d) || get_data(d) == 0 || get_data(d) == -1) {
+            return 0;
+        }
+    }
+    return is_invariant(get_child(ast, 0), assigned) && is_invariant(get_child(ast, 1), assigned);
+}
+
+static int has_var(AST* ast) {
+    if (get_kind(ast) == VAR_USE_NODE) {
+        return 1;
+    }
+    for (int i = 0; i < get_child_count(ast); i++) {
+        if (has_var(get_child(ast, i))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Troca cada expressão invariante maximal por um temporário; expressões
+// iguais dividem o mesmo. Subárvores só de constantes ficam para o fold.
+static void hoist_in(AST* ast, VarSet* assigned, AST* pre) {
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* child = get_child(ast, i);
+        if (is_bin_op(get_kind(child)) && has_var(child) && is_invariant(child, assigned)) {
+            int temp = -1;
+            for (int h = 0; h < get_child_count(pre) && temp == -1; h++) {
+                AST* assign = get_child(pre, h);
+                if (same_tree(get_child(assign, 1), child)) {
+                    temp = get_data(get_child(assign, 0));
+                }
+            }
+            if (temp == -1) {
+                temp = new_loop_temp('h');
+                add_child(pre, new_subtree(ASSIGN_NODE, 2, new_node(VAR_USE_NODE, temp), child));
+                loop_stats.hoisted++;
+            }
+            set_child(ast, i, new_node(VAR_USE_NODE, temp));
+        }
+        else {
+            hoist_in(child, assigned, pre);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// Devolve o que fica no lugar do laço: ele mesmo, o bloco desenrolado ou um
+// bloco com os cálculos tirados do laço seguidos do laço.
+static AST* optimize_loop(AST* loop, AST* prev) {
+    AST* unrolled = unroll(loop, prev);
+    if (unrolled != NULL) {
+        return unrolled;
+    }
+    VarSet assigned = { NULL, 0, 0 };
+    collect_assigned(loop, &assigned);
+    AST* pre = new_subtree(BLOCK_NODE, 0);
+    reduce_strength(loop, &assigned, pre);
+
+    AST* hoisted = new_subtree(BLOCK_NODE, 0);
+    hoist_in(loop, &assigned, hoisted);
+    free(assigned.t);
+
+    if (get_child_count(pre) == 0 && get_child_count(hoisted) == 0) {
+        return loop;
+    }
+    AST* block = new_subtree(BLOCK_NODE, 0);
+    for (int i = 0; i < get_child_count(hoisted); i++) {
+        add_child(block, get_child(hoisted, i));
+    }
+    for (int i = 0; i < get_child_count(pre); i++) {
+        add_child(block, get_child(pre, i));
+    }
+    add_child(block, loop);
+    return block;
+}
+
+static void optimize_loops_in(AST* ast) {
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* child = get_child(ast, i);
+        optimize_loops_in(child);
+        if (get_kind(child) == WHILE_NODE) {
+            AST* prev = get_kind(ast) == BLOCK_NODE && i > 0 ? get_child(ast, i - 1) : NULL;
+            set_child(ast, i, optimize_loop(child, prev));
+        }
+    }
+}
+
+LoopStats optimize_loops(AST* ast) {
+    LoopStats zero = { 0, 0, 0 };
+    loop_stats = zero;
+    loop_serial = 0;
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* func_decl = get_child(ast, i);
+        int func_id = get_data(get_child(get_child(func_decl, 0), 0));
+        AST* func_body = get_child(func_decl, 1);
+        loop_scope = get_func_scope(ft, func_id);
+        loop_vars = get_child(func_body, 0);
+        optimize_loops_in(get_child(func_body, 1));
+    }
+    return loop_stats;
+}
+
+// Tail calls -----------------------------------------------------------------
+
+// Uma chamada em cauda sobrescreve o registro de ativação corrente, então ela
+// não pode receber o endereço de um vetor local desse registro.
+static int passes_local_array(AST* fcall) {
+    AST* arg_list = get_child(fcall, 0);
+    for (int i = 0; i < get_child_count(arg_list); i++) {
+        AST* arg = get_child(arg_list, i);
+        if (get_kind(arg) == VAR_USE_NODE && get_child_count(arg) == 0
+                && get_size(vt, get_data(arg)) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Como o return sai da função na hora, todo 'return f(...)' está em posição
+// de cauda, mesmo dentro de laços e ifs.
+static int mark_tail_stmts(AST* ast) {
+    int marked = 0;
+    if (get_kind(ast) == RETURN_NODE && get_child_count(ast) == 1) {
+        AST* expr = get_child(ast, 0);
+        if (get_kind(expr) == FUNCTION_CALL_NODE && !passes_local_array(expr)) {
+            set_kind(expr, TAIL_CALL_NODE);
+            marked++;
+        }
+    }
+    else if (get_kind(ast) == BLOCK_NODE || get_kind(ast) == IF_NODE || get_kind(ast) == WHILE_NODE) {
+        for (int i = 0; i < get_child_count(ast); i++) {
+            marked += mark_tail_stmts(get_child(ast, i));
+        }
+    }
+    return marked;
+}
+
+int mark_tail_calls(AST* ast) {
+    int marked = 0;
+    for (int i = 0; i < get_child_count(ast); i++) {
+        AST* func_body = get_child(get_child(ast, i), 1);
+        marked += mark_tail_stmts(get_child(func_body, 1));
+    }
+    return marked;
+}
+
+void optimize(AST* ast, int opt_level, int inline_budget, FILE* report) {
+    if (opt_level >= 1) {
+        if (inline_budget > 0) {
+            InlineStats is = inline_calls(ast, inline_budget, report);
+            if (report != NULL) {
+                fprintf(report, "inline: %d calls to %d functions\n", is.sites, is.functions);
+            }
+        }
+        LoopStats ls = optimize_loops(ast);
+        if (report != NULL) {
+            fprintf(report, "loops: %d invariants hoisted, %d products strength-reduced, %d loops unrolled\n",
+                    ls.hoisted, ls.reduced, ls.unrolled);
+        }
+        FoldStats fs = fold_constants(ast);
+        if (report != NULL) {
+            fprintf(report, "fold: %d constant subtrees, %d identities, %d shifts, %d constant branches\n",
+                    fs.folded, fs.identities, fs.shifts, fs.branches);
+        }
+    }
+    mark_tail_calls(ast);
+}
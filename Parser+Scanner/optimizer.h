@@ -0,0 +1,59 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stdio.h>
+#include "ast.h"
+
+// AST to AST passes, run between yyparse() and the execution engines.
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    int folded;     // constant subtrees replaced by a single number
+    int identities; // x+0, x-0, x*1, x/1 and side-effect free x*0
+    int shifts;     // multiplications by a power of two turned into shifts
+    int branches;   // if/while statements with a constant test removed
+} FoldStats;
+
+// Folds constant subtrees into INT_VAL_NODEs and applies algebraic
+// identities. The tree is rewritten in place (enabled by -O1).
+FoldStats fold_constants(AST* ast);
+
+typedef struct {
+    int functions;  // functions inlined at least once
+    int sites;      // calls replaced by a copy of the body
+} InlineStats;
+
+// Replaces calls to small leaf functions (no calls of their own, no local
+// arrays, return only as the last statement, at most 'budget' nodes) by an
+// INLINE_NODE with a copy of the body. Parameters and locals become renamed
+// variables of the caller; array parameters use the caller's array directly.
+// One line per inlined function goes to 'report' unless it is NULL.
+InlineStats inline_calls(AST* ast, int budget, FILE* report);
+
+typedef struct {
+    int hoisted;    // invariant expressions computed once, before their loop
+    int reduced;    // induction variable products turned into running sums
+    int unrolled;   // short constant-trip-count loops fully unrolled
+} LoopStats;
+
+// Optimizes every while loop, innermost first: unrolls loops with a known
+// trip count of at most 8, strength-reduces i * k (i an induction variable,
+// k invariant) and hoists invariant arithmetic into temporaries assigned
+// before the loop (enabled by -O1).
+LoopStats optimize_loops(AST* ast);
+
+// Turns every 'return f(...);' into a TAIL_CALL_NODE (return leaves the
+// function at once, so the call is always in tail position). The engines
+// run it reusing the caller's activation record.
+// Returns how many calls were marked.
+int mark_tail_calls(AST* ast);
+
+// Maximum size, in AST nodes, of a function body expanded by the inliner.
+#define DEFAULT_INLINE_BUDGET 32
+
+// Every pass above for the given level: at -O1 inlining (unless budget is 0),
+// loops and constant folding, then tail call marking. What each pass did goes
+// to 'report' (trab5 --opt-report) unless it is NULL.
+void optimize(AST* ast, int opt_level, int inline_budget, FILE* report);
+
+#endif // OPTIMIZER_H
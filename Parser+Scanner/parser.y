@@ -3,6 +3,14 @@
 %define parse.error verbose
 %define parse.lac full
 
+%define api.pure full
+%parse-param {Compilation* c}
+%lex-param {Compilation* c}
+
+%code requires {
+#include "compilation.h"
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,52 +19,45 @@
 #include "tables.h"
 #include "ast.h"
 #include "parser.h"
-#include "interpreter.h"
-
-void mystrdup(char** destination, char* source);
-int yylex();
-int yylex_destroy(void);
-void yyerror(const char *s);
-
-AST* check_var(char* name);
-AST* new_var(char* name, int size);
 
-AST* check_func(char* name);
-AST* new_func(char* name);
+// Funções do scanner (scanner.l).
+int scan_token(YYSTYPE* yylval, void* scanner);
+int scanner_line(Compilation* c);
 
-extern char *yytext;
-extern int yylineno;
+static int yylex(YYSTYPE* yylval, Compilation* c);
+void yyerror(Compilation* c, const char *s);
 
-StrTable *st;
-VarTable *vt;
-FuncTable *ft;
+AST* check_var(Compilation* c, int name);
+AST* new_var(Compilation* c, int name, int size);
 
-Type func_type;
+AST* check_func(Compilation* c, int name, int arguments);
+AST* new_func(Compilation* c, int name);
 
-int scope = 0; /* contador de escopo para adição de variáveis na vt. */
-int arity = 0; /* contador de aridade para adição de funções na ft. É resetado quando uma função é adicionada. */
-int arguments = 0; /* contador de argumentos passados para uma função. É usado para checar se bate com a aridade. Também resetado após cada chamada de função. */
-
-char* id = NULL;
-char* prev_id = NULL; /* O acesso de uma posição de vetor através de variável requer dois ids, por isso esse ponteiro auxiliar guarda o id anterior. */
-int num;
-char* func_id = NULL;
-
-AST* root = NULL;
+/* Todo o estado fica em c: as tabelas, o escopo corrente (para adição de
+   variáveis na vt) e a aridade da função sendo declarada (para adição na ft,
+   zerada quando a função é adicionada). */
 
 %}
 
-%define api.value.type {AST*}
+%union {
+    AST* ast;
+    int name; /* índice do identificador em ids. */
+}
 
 %token ELSE IF INPUT INT OUTPUT RETURN VOID WHILE WRITE
 %token SEMI COMMA LPAREN RPAREN LBRACK RBRACK LBRACE RBRACE
 %token ASSIGN
 %token LT LE GT GE EQ NEQ
 
-%token ID
-%token NUM
+%token <name> ID
+%token <ast> NUM
+
+%token <ast> STRING
 
-%token STRING
+%type <ast> func_decl_list func_decl func_header func_body opt_var_decl opt_stmt_list
+%type <ast> params param_list param var_decl_list var_decl stmt_list stmt assign_stmt lval
+%type <ast> if_stmt block while_stmt return_stmt func_call input_call output_call write_call
+%type <ast> user_func_call opt_arg_list arg_list bool_expr arith_expr
 
 %left PLUS MINUS
 %left TIMES OVER
@@ -66,12 +67,12 @@ AST* root = NULL;
 %%
 
 program:
-  func_decl_list { root = $1; }
+  func_decl_list { c->root = $1; }
 ;
 
 func_decl_list:
-  func_decl                { $$ = new_subtree(FUNC_LIST_NODE, 1, $1); scope++; }
-| func_decl_list func_decl { add_child($1, $2); $$ = $1; scope++; }
+  func_decl                { $$ = new_subtree(FUNC_LIST_NODE, 1, $1); c->scope++; }
+| func_decl_list func_decl { add_child($1, $2); $$ = $1; c->scope++; }
 ;
 
 func_decl:
@@ -79,7 +80,7 @@ func_decl:
 ;
 
 func_header:
-  ret_type ID { mystrdup(&func_id, id); } LPAREN params RPAREN { $$ = new_subtree(FUNCTION_HEADER_NODE, 2, new_func(func_id), $5); }
+  ret_type ID LPAREN params RPAREN { $$ = new_subtree(FUNCTION_HEADER_NODE, 2, new_func(c, $2), $4); }
 ;
 
 func_body:
@@ -97,8 +98,8 @@ opt_stmt_list:
 ;
 
 ret_type:
-  INT   { func_type = INT_TYPE; }
-| VOID  { func_type = VOID_TYPE; }
+  INT   { c->func_type = INT_TYPE; }
+| VOID  { c->func_type = VOID_TYPE; }
 ;
 
 params:
@@ -112,8 +113,8 @@ param_list:
 ;
 
 param:
-  INT ID { $$ = new_var(id, 0); arity++; }
-| INT ID LBRACK RBRACK { $$ = new_var(id, -1); arity++; }
+  INT ID { $$ = new_var(c, $2, 0); c->arity++; }
+| INT ID LBRACK RBRACK { $$ = new_var(c, $2, -1); c->arity++; }
 ;
 
 var_decl_list:
@@ -122,8 +123,8 @@ var_decl_list:
 ;
 
 var_decl:
-  INT ID { $2 = new_var(id, 0); } SEMI { $$ = $2; }
-| INT ID LBRACK NUM RBRACK { $2 = new_var(id, num); add_child($2, $4); } SEMI { $$ = $2; }
+  INT ID SEMI { $$ = new_var(c, $2, 0); }
+| INT ID LBRACK NUM RBRACK SEMI { $$ = new_var(c, $2, get_data($4)); add_child($$, $4); }
 ;
 
 stmt_list:
@@ -144,9 +145,9 @@ assign_stmt:
 ;
 
 lval:
-  ID { $$ = check_var(id); }
-| ID LBRACK NUM RBRACK { $1 = check_var(id); add_child($1, $3); $$ = $1; }
-| ID LBRACK ID { $1 = check_var(prev_id); $2 = check_var(id); add_child($1, $2); $$ = $1; } RBRACK
+  ID { $$ = check_var(c, $1); }
+| ID LBRACK NUM RBRACK { $$ = check_var(c, $1); add_child($$, $3); }
+| ID LBRACK ID RBRACK { $$ = check_var(c, $1); add_child($$, check_var(c, $3)); }
 ;
 
 if_stmt:
@@ -186,7 +187,7 @@ write_call:
 ;
 
 user_func_call:
-  ID { mystrdup(&func_id, id); } LPAREN opt_arg_list RPAREN { $1 = check_func(func_id); add_child($1, $4); $$ = $1; arguments = 0; }
+  ID LPAREN opt_arg_list RPAREN { $$ = check_func(c, $1, get_child_count($3)); add_child($$, $3); }
 ;
 
 opt_arg_list:
@@ -195,8 +196,8 @@ opt_arg_list:
 ;
 
 arg_list:
-  arith_expr                { $$ = new_subtree(ARG_LIST_NODE, 1, $1); arguments++; }
-| arg_list COMMA arith_expr { add_child($1, $3); $$ = $1; arguments++; } 
+  arith_expr                { $$ = new_subtree(ARG_LIST_NODE, 1, $1); }
+| arg_list COMMA arith_expr { add_child($1, $3); $$ = $1; }
 ;
 
 bool_expr:
@@ -222,97 +223,61 @@ arith_expr:
 
 %%
 
-AST* check_var(char* name) {
-    int idx = lookup_var(vt, name, scope);
+// Depois do primeiro erro o parser para no próximo token: YYerror o leva
+// direto à recuperação de erros, sem mensagem, e como a gramática não tem
+// regras de recuperação o yyparse retorna.
+static int yylex(YYSTYPE* yylval, Compilation* c) {
+    if (c->error[0] != '\0') {
+        return YYerror;
+    }
+    return scan_token(yylval, c->scanner);
+}
+
+AST* check_var(Compilation* c, int name) {
+    int idx = lookup_var(c->vt, name, c->scope);
     if (idx == -1) {
-        printf("SEMANTIC ERROR (%d): variable '%s' was not declared.\n",
-                yylineno, name);
-        exit(EXIT_FAILURE);
+        compile_error(c, "SEMANTIC ERROR (%d): variable '%s' was not declared.",
+                scanner_line(c), get_string(c->ids, name));
     }
     return new_node(VAR_USE_NODE, idx);
 }
 
-AST* new_var(char* name, int size) {
-    int idx = lookup_var(vt, name, scope);
+AST* new_var(Compilation* c, int name, int size) {
+    int idx = lookup_var(c->vt, name, c->scope);
     if (idx != -1) {
-        printf("SEMANTIC ERROR (%d): variable '%s' already declared at line %d.\n",
-                yylineno, name, get_line(vt, idx));
-        exit(EXIT_FAILURE);
+        compile_error(c, "SEMANTIC ERROR (%d): variable '%s' already declared at line %d.",
+                scanner_line(c), get_string(c->ids, name), get_line(c->vt, idx));
     }
-    idx = add_var(vt, name, yylineno, scope, size);
+    idx = add_var(c->vt, name, scanner_line(c), c->scope, size);
     return new_node(VAR_DECL_NODE, idx);
 }
 
-AST* check_func(char* name) {
-  int idx = lookup_func(ft, name);
+AST* check_func(Compilation* c, int name, int arguments) {
+  int idx = lookup_func(c->ft, name);
   if (idx == -1) {
-    printf("SEMANTIC ERROR (%d): function '%s' was not declared.\n", yylineno, name);
-    exit(EXIT_FAILURE);
+    compile_error(c, "SEMANTIC ERROR (%d): function '%s' was not declared.", scanner_line(c), get_string(c->ids, name));
   }
   else{
-    int expected_arity = get_func_arity(ft, idx);
+    int expected_arity = get_func_arity(c->ft, idx);
     if(arguments != expected_arity){
-        printf("SEMANTIC ERROR (%d): function '%s' was called with %d arguments but declared with %d parameters.\n", yylineno, name, arguments, expected_arity);
-        exit(EXIT_FAILURE);
+        compile_error(c, "SEMANTIC ERROR (%d): function '%s' was called with %d arguments but declared with %d parameters.", scanner_line(c), get_string(c->ids, name), arguments, expected_arity);
       }
     }
   return new_node(FUNCTION_CALL_NODE, idx);
 }
 
-AST* new_func(char* name) {
-    int idx = lookup_func(ft, name);
+AST* new_func(Compilation* c, int name) {
+    int idx = lookup_func(c->ft, name);
     if (idx != -1) {
-        printf("SEMANTIC ERROR (%d): function '%s' already declared at line %d.\n",
-                yylineno, name, get_func_line(ft, idx));
-        exit(EXIT_FAILURE);
+        compile_error(c, "SEMANTIC ERROR (%d): function '%s' already declared at line %d.",
+                scanner_line(c), get_string(c->ids, name), get_func_line(c->ft, idx));
     }
-    idx = add_func(ft, name, yylineno, arity, func_type);
-    arity = 0;
+    idx = add_func(c->ft, name, scanner_line(c), c->arity, c->func_type, c->scope);
+    c->arity = 0;
     return new_node(FUNCTION_NAME_NODE, idx);
 }
 
 // Error handling.
-void yyerror (char const *s) {
-    printf("PARSE ERROR (%d): %s\n", yylineno, s);
-    exit(EXIT_FAILURE);
-}
-
-// Main.
-int main() {
-    st = create_str_table();
-    vt = create_var_table();
-    ft = create_func_table();
-
-    yyparse();
-    //printf("PARSE SUCCESSFUL!\n");
-
-    //printf("\n\n");
-    //print_str_table(st); printf("\n\n");
-    //print_var_table(vt); printf("\n\n");
-    //print_func_table(ft); printf("\n\n");
-    
-    //print_dot(root);
-
-    stdin = fopen(ctermid(NULL), "r");
-    run_ast(root);
-
-    fclose(stdin);
-
-    free_str_table(st);
-    free_var_table(vt);
-    free_func_table(ft);
-    free_tree(root);
-    yylex_destroy();    // To avoid memory leaks within flex...]
-    
-    if(id != NULL){
-      free(id);
-    }
-    if(prev_id != NULL){
-      free(prev_id);
-    }
-    if(func_id != NULL){
-      free(func_id);
-    }
-
-    return 0;
+void yyerror (Compilation* c, char const *s) {
+    compile_error(c, "PARSE ERROR (%d): %s", scanner_line(c), s);
 }
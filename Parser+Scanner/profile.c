@@ -0,0 +1,245 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include "profile.h"
+#include "io.h"
+
+ShadowStack shadow_stack;
+int profiling = 0;
+
+// Árvore de chamadas ---------------------------------------------------------
+
+// Cada nó é um caminho distinto a partir de main; 'self' conta as amostras
+// tiradas exatamente nele. O nó 0 é a raiz, acima de main.
+typedef struct {
+    int parent;
+    int func;
+    long self;
+} CallNode;
+
+#define PROFILE_MAX_NODES (1 << 18)
+#define NODE_HASH_SIZE (2 * PROFILE_MAX_NODES)
+
+// Tudo é alocado em profile_start: o handler do sinal não pode chamar malloc.
+static CallNode* nodes = NULL;
+static int node_count = 0;
+static int* node_index = NULL; // (pai, função) -> nó, endereçamento aberto
+
+// Caminho da amostra anterior. Em geral a pilha muda pouco entre duas
+// amostras, então só a parte diferente precisa ser procurada na tabela.
+static int path_func[PROFILE_MAX_DEPTH];
+static int path_node[PROFILE_MAX_DEPTH];
+static int path_len = 0;
+
+static volatile long samples = 0;
+static volatile long dropped = 0; // árvore cheia
+static volatile long ticks = 0;   // todos os sinais, inclusive fora de main
+
+// O kernel só entrega o sinal no tick do escalonador (4 ms com HZ=250), então
+// o intervalo pedido é um mínimo. O tempo de cada amostra sai do tempo de
+// CPU medido entre o início e o fim, dividido pelo número de sinais.
+static struct timespec cpu_start;
+
+static char** func_names = NULL;
+static int func_count = 0;
+static FILE* folded = NULL;
+static int interval = 0;
+
+static int child(int parent, int func) {
+    unsigned h = ((unsigned) parent * 2654435761u ^ (unsigned) func * 40503u) & (NODE_HASH_SIZE - 1);
+    for (;;) {
+        int n = node_index[h];
+        if (n == -1) {
+            break;
+        }
+        if (nodes[n].parent == parent && nodes[n].func == func) {
+            return n;
+        }
+        h = (h + 1) & (NODE_HASH_SIZE - 1);
+    }
+    if (node_count == PROFILE_MAX_NODES) {
+        return -1;
+    }
+    int n = node_count++;
+    nodes[n].parent = parent;
+    nodes[n].func = func;
+    nodes[n].self = 0;
+    node_index[h] = n;
+    return n;
+}
+
+static void on_sample(int sig) {
+    ticks++;
+    int depth = shadow_stack.depth;
+    if (depth <= 0) {
+        return; // fora de main
+    }
+    if (depth > PROFILE_MAX_DEPTH) {
+        depth = PROFILE_MAX_DEPTH;
+    }
+    int i = 0;
+    while (i < depth && i < path_len && path_func[i] == shadow_stack.func[i]) {
+        i++;
+    }
+    int node = i == 0 ? 0 : path_node[i - 1];
+    for (; i < depth; i++) {
+        int func = shadow_stack.func[i];
+        node = child(node, func);
+        if (node == -1) {
+            path_len = i;
+            dropped++;
+            return;
+        }
+        path_func[i] = func;
+        path_node[i] = node;
+    }
+    path_len = depth;
+    nodes[node].self++;
+    samples++;
+}
+
+// Relatório -----------------------------------------------------------------
+
+static void write_folded(FILE* out) {
+    int* path = malloc(PROFILE_MAX_DEPTH * sizeof(int));
+    for (int n = 1; n < node_count; n++) {
+        if (nodes[n].self == 0) {
+            continue;
+        }
+        int len = 0;
+        for (int m = n; m != 0; m = nodes[m].parent) {
+            path[len++] = nodes[m].func;
+        }
+        for (int i = len - 1; i >= 0; i--) {
+            fprintf(out, "%s%c", func_names[path[i]], i == 0 ? ' ' : ';');
+        }
+        fprintf(out, "%ld\n", nodes[n].self);
+    }
+    free(path);
+}
+
+static long* self_of = NULL;
+static long* total_of = NULL;
+
+static int by_self(const void* a, const void* b) {
+    int f = *(const int*) a;
+    int g = *(const int*) b;
+    if (self_of[f] != self_of[g]) {
+        return self_of[f] < self_of[g] ? 1 : -1;
+    }
+    if (total_of[f] != total_of[g]) {
+        return total_of[f] < total_of[g] ? 1 : -1;
+    }
+    return f - g;
+}
+
+// Uma amostra conta uma vez só no total de cada função do caminho, mesmo
+// que ela apareça várias vezes (recursão).
+static void write_table(FILE* out) {
+    self_of = calloc(func_count, sizeof(long));
+    total_of = calloc(func_count, sizeof(long));
+    int* seen = malloc(func_count * sizeof(int));
+    int* order = malloc(func_count * sizeof(int));
+    for (int f = 0; f < func_count; f++) {
+        seen[f] = 0;
+        order[f] = f;
+    }
+    for (int n = 1; n < node_count; n++) {
+        if (nodes[n].self == 0) {
+            continue;
+        }
+        self_of[nodes[n].func] += nodes[n].self;
+        for (int m = n; m != 0; m = nodes[m].parent) {
+            if (seen[nodes[m].func] != n) {
+                seen[nodes[m].func] = n;
+                total_of[nodes[m].func] += nodes[n].self;
+            }
+        }
+    }
+    qsort(order, func_count, sizeof(int), by_self);
+
+    struct timespec cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    double cpu_ms = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e3 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e6;
+    double ms = ticks > 0 ? cpu_ms / ticks : interval / 1000.0;
+    double pct = samples > 0 ? 100.0 / samples : 0;
+    fprintf(out, "profile: %ld samples in %.1f ms of CPU time (one every %.2f ms)\n",
+            samples, cpu_ms, ms);
+    if (dropped > 0) {
+        fprintf(out, "profile: %ld samples dropped, call tree full\n", dropped);
+    }
+    fprintf(out, "%10s %6s %10s %6s  %s\n", "self ms", "self", "total ms", "total", "function");
+    for (int i = 0; i < func_count; i++) {
+        int f = order[i];
+        if (total_of[f] == 0) {
+            continue;
+        }
+        fprintf(out, "%10.1f %5.1f%% %10.1f %5.1f%%  %s\n",
+                self_of[f] * ms, self_of[f] * pct, total_of[f] * ms, total_of[f] * pct, func_names[f]);
+    }
+    free(order);
+    free(seen);
+    free(self_of);
+    free(total_of);
+}
+
+static void profile_finish(void) {
+    struct itimerval off;
+    memset(&off, 0, sizeof off);
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+    profiling = 0;
+
+    write_folded(folded);
+    fclose(folded);
+    io_flush(); // a tabela vem depois da saída do programa
+    write_table(stderr);
+
+    for (int f = 0; f < func_count; f++) {
+        free(func_names[f]);
+    }
+    free(func_names);
+    free(nodes);
+    free(node_index);
+}
+
+void profile_start(FuncTable* ft, char* folded_path, int interval_us) {
+    folded = fopen(folded_path, "w");
+    if (folded == NULL) {
+        perror(folded_path);
+        exit(EXIT_FAILURE);
+    }
+    func_count = get_func_count(ft);
+    func_names = malloc(func_count * sizeof(char*));
+    for (int f = 0; f < func_count; f++) {
+        func_names[f] = strdup(get_func_name(ft, f));
+    }
+    nodes = malloc(PROFILE_MAX_NODES * sizeof(CallNode));
+    node_index = malloc(NODE_HASH_SIZE * sizeof(int));
+    memset(node_index, -1, NODE_HASH_SIZE * sizeof(int));
+    nodes[0].parent = -1;
+    nodes[0].func = -1;
+    nodes[0].self = 0;
+    node_count = 1;
+    shadow_stack.depth = 0;
+    interval = interval_us;
+    profiling = 1;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    atexit(profile_finish);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_sample;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    struct itimerval every;
+    every.it_interval.tv_sec = interval_us / 1000000;
+    every.it_interval.tv_usec = interval_us % 1000000;
+    every.it_value = every.it_interval;
+    setitimer(ITIMER_PROF, &every, NULL);
+}
@@ -0,0 +1,63 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "tables.h"
+
+// Sampling profiler for C-minus programs (--profile).
+// ----------------------------------------------------------------------------
+
+// While profiling, every engine keeps a shadow stack with the index (in the
+// ft) of each C-minus function being executed. A CPU-time timer (ITIMER_PROF)
+// interrupts the program at a fixed rate and the signal handler adds the
+// current shadow stack to a call tree; nothing is written until the end.
+// Functions expanded by the inliner (-O1) are counted in their callers.
+
+// Frames deeper than this still count in 'depth', but samples taken there
+// are charged to the deepest recorded frame.
+#define PROFILE_MAX_DEPTH (1 << 16)
+
+// The JIT addresses the fields directly: depth at offset 0, func at offset 4.
+typedef struct {
+    volatile int depth;
+    volatile int func[PROFILE_MAX_DEPTH];
+} ShadowStack;
+
+extern ShadowStack shadow_stack;
+
+// Set by profile_start. The engines only emit or run the bookkeeping below
+// when it is set, so a run without --profile pays nothing.
+extern int profiling;
+
+static inline void profile_enter(int func_id) {
+    int d = shadow_stack.depth;
+    if (d < PROFILE_MAX_DEPTH) {
+        shadow_stack.func[d] = func_id;
+    }
+    shadow_stack.depth = d + 1;
+}
+
+static inline void profile_leave(void) {
+    shadow_stack.depth--;
+}
+
+// Tail call: the callee takes the caller's place on the stack.
+static inline void profile_replace(int func_id) {
+    int d = shadow_stack.depth - 1;
+    if (d < PROFILE_MAX_DEPTH) {
+        shadow_stack.func[d] = func_id;
+    }
+}
+
+// Starts sampling every 'interval_us' microseconds of CPU time. The kernel
+// rounds this up to its timer tick, so the report divides the measured CPU
+// time by the number of signals instead of trusting the interval. The
+// function names are copied from 'ft', so the table may be freed before the
+// report.
+// At exit (including exit() after a runtime error) the samples are written
+// to 'folded_path' as folded stacks, one "main;f;g 12" line per distinct
+// stack (the input format of flamegraph.pl, inferno and speedscope), and a
+// table with the exclusive (self) and inclusive (total) samples of each
+// function is printed to stderr.
+void profile_start(FuncTable* ft, char* folded_path, int interval_us);
+
+#endif // PROFILE_H
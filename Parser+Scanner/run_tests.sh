@@ -0,0 +1,173 @@
+#!/bin/bash
+# Roda todos os programas de in/ e compara a saída com out2/.
+# Os programas válidos (c*.cm) também são compilados com o backend AOT
+# (-o, via gcc) e o executável gerado tem que produzir a mesma saída, e
+# rodam também com -O1 (inlining, laços e dobra de constantes), com o JIT
+# (--jit, com e sem -O1) e com --profile, --stats e --trace, cuja
+# instrumentação não pode mudar o resultado; as pilhas que o --profile grava
+# têm que começar em main e terminar com o número de amostras, e o JSON do
+# --stats tem que ser válido, com o motor certo e main chamada uma vez; o
+# tracedump tem que ler o --trace, e no da VM o último passo é o halt.
+# Também rodam pela libcminus (cmrun): compilados uma vez e executados várias
+# vezes em várias threads ao mesmo tempo.
+# Programas que usam input() leem de in/<nome>.in, se existir.
+# Por fim, o diretório inteiro é compilado de uma vez com --dir, em várias
+# threads, e cada arquivo tem que ter o mesmo resultado que sozinho.
+
+cd "$(dirname "$0")"
+
+IN=in
+OUT=out2
+
+EXE=./trab5
+LIB=./cmrun
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+fail=0
+count=0
+
+check() { # nome, modo, saída obtida
+    count=$((count + 1))
+    if ! cmp -s $3 $OUT/$1.out; then
+        echo "FAIL $1 ($2)"
+        diff $3 $OUT/$1.out | head -5
+        fail=$((fail + 1))
+    fi
+}
+
+artifact() { # nome, modo, comando que valida o arquivo gravado
+    count=$((count + 1))
+    local name=$1 mode=$2
+    shift 2
+    if ! "$@"; then
+        echo "FAIL $name ($mode)"
+        fail=$((fail + 1))
+    fi
+}
+
+# Uma linha por pilha: "main;f;g 12". Programa curto pode não ter amostra
+# nenhuma, então o arquivo vazio vale.
+folded_ok() {
+    ! grep -qvE '^main(;[^ ;]+)* [0-9]+$' $1
+}
+
+# json.tool só se houver python3; o resto é grep no formato que stats.c grava.
+stats_ok() { # arquivo, motor
+    if command -v python3 > /dev/null; then
+        python3 -m json.tool $1 > /dev/null 2>&1 || return 1
+    fi
+    grep -q "^  \"engine\": \"$2\",\$" $1 &&
+        sed -n '/^  "calls": {/,/^  }/p' $1 | grep -qE '^    "main": 1,?$'
+}
+
+# O último passo que o tracedump imprime termina com o nome da instrução (ou do
+# nó, no --ast); sem o segundo argumento basta o arquivo ser lido.
+trace_ends() { # arquivo, último passo esperado
+    local last
+    last=$(./tracedump -n 1 $1 2>/dev/null) || return 1
+    [ -z "$2" ] || [[ ${last##*$'\n'} == *" $2" ]]
+}
+
+for infile in $IN/*.cm; do
+    base=$(basename $infile .cm)
+    input=$IN/$base.in
+    [ -f $input ] || input=/dev/null
+
+    $EXE $infile --input $input > $TMP/out 2>/dev/null
+    check $base vm $TMP/out
+
+    case $base in c*)
+        $EXE $infile --ast --input $input > $TMP/out 2>/dev/null
+        check $base ast $TMP/out
+
+        $EXE $infile -O1 --input $input > $TMP/out 2>/dev/null
+        check $base O1 $TMP/out
+
+        $EXE $infile --jit --input $input > $TMP/out 2>/dev/null
+        check $base jit $TMP/out
+
+        $EXE $infile -O1 --jit --input $input > $TMP/out 2>/dev/null
+        check $base "O1 jit" $TMP/out
+
+        $EXE $infile --profile $TMP/folded --input $input > $TMP/out 2>/dev/null
+        check $base profile $TMP/out
+        artifact $base "profile stacks" folded_ok $TMP/folded
+
+        $EXE $infile --stats $TMP/stats.json --input $input > $TMP/out 2>/dev/null
+        check $base stats $TMP/out
+        artifact $base "stats json" stats_ok $TMP/stats.json vm
+
+        $EXE $infile --ast --stats $TMP/stats.json --input $input > $TMP/out 2>/dev/null
+        check $base "ast stats" $TMP/out
+        artifact $base "ast stats json" stats_ok $TMP/stats.json ast
+
+        $EXE $infile --trace $TMP/trace --input $input > $TMP/out 2>/dev/null
+        check $base trace $TMP/out
+        artifact $base "trace halt" trace_ends $TMP/trace halt
+
+        $EXE $infile --ast --trace $TMP/trace --input $input > $TMP/out 2>/dev/null
+        check $base "ast trace" $TMP/out
+        artifact $base "ast trace file" trace_ends $TMP/trace
+
+        $LIB -t 4 -n 2 $infile < $input > $TMP/out 2>/dev/null
+        check $base lib $TMP/out
+
+        if $EXE $infile -o $TMP/$base; then
+            $TMP/$base < $input > $TMP/out
+        else
+            echo "(compilation failed)" > $TMP/out
+        fi
+        check $base aot $TMP/out
+    esac
+done
+
+# --batch lê a entrada em blocos, direto do descritor 0. Um número pode chegar
+# dividido entre dois read, como num pipe escrito aos poucos; o fim da entrada
+# e um valor que não é inteiro são erros, depois da saída já produzida.
+check_batch() { # nome, saída esperada (stdout, stderr e status)
+    count=$((count + 1))
+    $EXE $IN/c22.cm --batch > $TMP/out 2>&1
+    echo "exit $?" >> $TMP/out
+    if ! printf "$2" | cmp -s - $TMP/out; then
+        echo "FAIL --batch ($1)"
+        printf "$2" | diff $TMP/out - | head -5
+        fail=$((fail + 1))
+    fi
+}
+
+chunked() {
+    for chunk in '4 1' 2 '3 -' 4 '5 1234567' 890 '123 ' 7; do
+        printf -- "$chunk"
+        sleep 0.1
+    done
+}
+
+check_batch chunked '123\n-45\n1912276171\n7\nexit 0\n' < <(chunked)
+check_batch long '1215752191\n539222987\n42\nexit 0\n' \
+    < <(printf '3 99999999999 -12345678901 +000000000042')
+check_batch eof '5\n6\ninput(): end of input after 3 values.\nexit 1\n' \
+    < <(printf '3 5 6')
+check_batch "not an integer" '7\ninput(): not an integer after 2 values.\nexit 1\n' \
+    < <(printf '2 7 x')
+
+# O resultado esperado de cada arquivo no --dir: o erro de compilação que ele
+# imprime sozinho, ou ok.
+for infile in $IN/*.cm; do
+    base=$(basename $infile .cm)
+    error=$(head -1 $OUT/$base.out | grep -E '^(SCANNING|PARSE|SEMANTIC) ERROR')
+    echo "$infile: ${error:-ok}"
+done > $TMP/dir.out
+
+for mode in --check-only -O0 -O1; do
+    count=$((count + 1))
+    $EXE --dir $IN --jobs 4 $mode > $TMP/out 2>/dev/null
+    if ! cmp -s $TMP/out $TMP/dir.out; then
+        echo "FAIL --dir ($mode)"
+        diff $TMP/out $TMP/dir.out | head -5
+        fail=$((fail + 1))
+    fi
+done
+
+echo "$((count - fail))/$count passed."
+[ $fail -eq 0 ]
@@ -0,0 +1,80 @@
+#!/bin/bash
+# Mede o tempo do front end (scanner, parser e checagens, com --check-only)
+# em programas gerados pelo genprog, de mil comandos até MAX (padrão 10^6),
+# com uma função a cada cem comandos (até 10^4 funções).
+# Escreve os pontos em scaling.dat, desenha a curva no terminal e, se o
+# gnuplot estiver instalado, também em scaling.png (escala log-log).
+# Uso: ./scaling.sh [MAX]
+
+cd "$(dirname "$0")"
+
+EXE=./trab5
+GEN=./genprog
+MAX=${1:-1000000}
+RUNS=3
+DATA=scaling.dat
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+# O tempo é o da fase "parse" do --stats, sem o início e o fim do processo.
+parse_ms() {
+    sed -n 's/.*"parse": { "wall_ms": \([0-9.]*\).*/\1/p' $1
+}
+
+sizes=""
+for exp in 1000 10000 100000 1000000 10000000; do
+    for m in 1 2 5; do
+        n=$((exp * m))
+        [ $n -le $MAX ] && sizes="$sizes $n"
+    done
+done
+
+echo "# statements functions bytes parse_ms ns_per_statement" > $DATA
+printf "%11s %9s %11s %10s %9s\n" statements functions bytes "parse ms" "ns/stmt"
+for n in $sizes; do
+    funcs=$((n / 100))
+    [ $funcs -lt 1 ] && funcs=1
+    [ $funcs -gt 10000 ] && funcs=10000
+    $GEN -f $funcs -s $n > $TMP/prog.cm
+    bytes=$(wc -c < $TMP/prog.cm)
+    best=""
+    for run in $(seq $RUNS); do
+        if ! $EXE $TMP/prog.cm --check-only --stats $TMP/stats.json > $TMP/out; then
+            echo "trab5 failed on $n statements:"
+            head -5 $TMP/out
+            exit 1
+        fi
+        ms=$(parse_ms $TMP/stats.json)
+        best=$(echo "$ms $best" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')
+    done
+    ns=$(echo "$best $n" | awk '{ printf "%.0f", $1 * 1e6 / $2 }')
+    echo "$n $funcs $bytes $best $ns" >> $DATA
+    printf "%11d %9d %11d %10.2f %9d\n" $n $funcs $bytes $best $ns
+done
+
+# As barras vão em escala logarítmica: com os tamanhos em passos 1-2-5, um
+# front end linear cresce o mesmo tanto a cada década.
+echo
+awk '!/^#/ { n[NR] = $1; t[NR] = $4; last = NR }
+     END {
+         max = log(t[last]); min = log(t[2] > 0 ? t[2] : 0.001)
+         for (i = 2; i <= last; i++) {
+             w = t[i] > 0 ? int(60 * (log(t[i]) - min) / (max - min + 1e-9)) + 1 : 1
+             bar = ""; for (j = 0; j < w; j++) bar = bar "#"
+             printf "%9d | %-61s %.2f ms\n", n[i], bar, t[i]
+         }
+     }' $DATA
+
+if command -v gnuplot > /dev/null; then
+    gnuplot <<EOF
+set terminal png size 800,500
+set output "scaling.png"
+set logscale xy
+set xlabel "statements"
+set ylabel "parse + check (ms)"
+set key left top
+plot "$DATA" using 1:4 with linespoints title "trab5 --check-only", \
+     "$DATA" using 1:(\$1 * $(awk '!/^#/ { r = $4 / $1 } END { print r }' $DATA)) with lines dashtype 2 title "linear"
+EOF
+    echo "Plot written to scaling.png."
+fi
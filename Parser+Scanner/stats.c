@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+#include "io.h"
+
+RunStats run_stats;
+int stats_enabled = 0;
+
+static FILE* out = NULL;
+static char* engine = "vm";
+static char** func_names = NULL;
+static int func_count = 0;
+
+// Tempos ---------------------------------------------------------------------
+
+typedef struct {
+    double wall;
+    double cpu;
+} Clock;
+
+static Clock now(void) {
+    struct timespec w, c;
+    clock_gettime(CLOCK_MONOTONIC, &w);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c);
+    Clock t = { w.tv_sec * 1e3 + w.tv_nsec / 1e6, c.tv_sec * 1e3 + c.tv_nsec / 1e6 };
+    return t;
+}
+
+static Clock started;
+static Clock phase_start[PHASE_COUNT];
+static Clock phase_time[PHASE_COUNT];
+
+static char* phase_names[PHASE_COUNT] = { "parse", "optimize", "compile", "execute" };
+
+void stats_begin(Phase phase) {
+    if (stats_enabled) {
+        phase_start[phase] = now();
+    }
+}
+
+void stats_end(Phase phase) {
+    if (stats_enabled) {
+        Clock t = now();
+        phase_time[phase].wall += t.wall - phase_start[phase].wall;
+        phase_time[phase].cpu += t.cpu - phase_start[phase].cpu;
+    }
+}
+
+// Relatório -----------------------------------------------------------------
+
+static void write_time(char* name, Clock t, int last) {
+    fprintf(out, "    \"%s\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f }%s\n", name, t.wall, t.cpu, last ? "" : ",");
+}
+
+// Só os contadores diferentes de zero, para o relatório não encher de opcodes
+// e tipos de nó que o programa nunca usou.
+static void write_counts(char* key, long long* counts, int n, char* (*name)(int)) {
+    fprintf(out, "  \"%s\": {", key);
+    char* sep = "";
+    for (int i = 0; i < n; i++) {
+        if (counts[i] != 0) {
+            fprintf(out, "%s\n    \"%s\": %lld", sep, name(i), counts[i]);
+            sep = ",";
+        }
+    }
+    fprintf(out, "%s},\n", *sep ? "\n  " : " ");
+}
+
+static char* kind_name(int i) {
+    return kind2str((NodeKind) i);
+}
+
+static char* op_name(int i) {
+    return op2str((OpCode) i);
+}
+
+static char* func_name(int i) {
+    return func_names[i];
+}
+
+static void stats_finish(void) {
+    Clock total = now();
+    total.wall -= started.wall;
+    total.cpu -= started.cpu;
+    int counted = strcmp(engine, "ast") == 0 || strcmp(engine, "vm") == 0;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"engine\": \"%s\",\n", engine);
+    fprintf(out, "  \"time\": {\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        write_time(phase_names[p], phase_time[p], 0);
+    }
+    write_time("total", total, 1);
+    fprintf(out, "  },\n");
+
+    if (strcmp(engine, "ast") == 0) {
+        fprintf(out, "  \"node_visits\": %lld,\n", run_stats.steps);
+        write_counts("by_kind", run_stats.by_kind, NODE_KIND_COUNT, kind_name);
+    }
+    else if (strcmp(engine, "vm") == 0) {
+        fprintf(out, "  \"instructions\": %lld,\n", run_stats.steps);
+        write_counts("by_opcode", run_stats.by_op, OP_COUNT, op_name);
+    }
+    if (run_stats.calls != NULL && strcmp(engine, "c") != 0) {
+        write_counts("calls", run_stats.calls, func_count, func_name);
+    }
+    if (counted) {
+        fprintf(out, "  \"max_stack_depth\": %d,\n", run_stats.max_stack);
+        fprintf(out, "  \"mem_cells\": %d,\n", run_stats.max_mem);
+    }
+    fprintf(out, "  \"io\": { \"bytes_in\": %lld, \"bytes_out\": %lld }\n", io_bytes_in(), io_bytes_out());
+    fprintf(out, "}\n");
+    fclose(out);
+
+    for (int f = 0; f < func_count; f++) {
+        free(func_names[f]);
+    }
+    free(func_names);
+    free(run_stats.calls);
+}
+
+void stats_start(char* path) {
+    out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    memset(&run_stats, 0, sizeof run_stats);
+    stats_enabled = 1;
+    started = now();
+    atexit(stats_finish);
+}
+
+void stats_program(FuncTable* ft) {
+    if (!stats_enabled) {
+        return;
+    }
+    func_count = get_func_count(ft);
+    func_names = malloc(func_count * sizeof(char*));
+    for (int f = 0; f < func_count; f++) {
+        func_names[f] = strdup(get_func_name(ft, f));
+    }
+    run_stats.calls = calloc(func_count, sizeof(long long));
+}
+
+void stats_engine(char* name) {
+    engine = name;
+}
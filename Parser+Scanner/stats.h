@@ -0,0 +1,54 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "ast.h"
+#include "bytecode.h"
+#include "tables.h"
+
+// Run statistics (--stats=FILE).
+// ----------------------------------------------------------------------------
+
+// The engines only count with stats_enabled set, and they check it once per
+// run, not per step: the AST walker links a counting handler around every
+// node, the VM runs a separate copy of its loop and the JIT emits call
+// counters. A run without --stats executes exactly the same code as before.
+
+typedef enum {
+    PHASE_PARSE,    // scanner and parser; the semantic checks run in the parser actions
+    PHASE_OPTIMIZE, // AST optimizations (-O1) and tail call marking
+    PHASE_COMPILE,  // bytecode, machine code or C generation
+    PHASE_EXECUTE,  // the program itself (for --ast, also resolve_ast and link_ast)
+    PHASE_COUNT
+} Phase;
+
+typedef struct {
+    long long steps;                    // AST nodes visited or VM instructions executed
+    long long by_kind[NODE_KIND_COUNT]; // AST walker: visits by node kind
+    long long by_op[OP_COUNT];          // VM: instructions by opcode
+    long long* calls;                   // calls by function id in the ft (main included)
+    int max_stack;                      // data stack high-water mark, in cells
+    int max_mem;                        // activation records high-water mark, in cells
+} RunStats;
+
+extern RunStats run_stats;
+extern int stats_enabled;
+
+// Turns statistics on. The JSON report is written to 'path' at exit
+// (including exit() after a runtime error).
+void stats_start(char* path);
+
+// Called once the program is parsed: the function names are copied from
+// 'ft', so the table may be freed before the report.
+void stats_program(FuncTable* ft);
+
+// Names the engine that runs the program ("ast", "vm", "jit", "c", or "none"
+// with --check-only), which decides what the report can say: the JIT only
+// counts calls.
+void stats_engine(char* engine);
+
+// Phase timers (wall and CPU time). A phase may be entered more than once;
+// the times add up. No-ops without --stats.
+void stats_begin(Phase phase);
+void stats_end(Phase phase);
+
+#endif // STATS_H
@@ -5,35 +5,164 @@
 #include "tables.h"
 #include "ast.h"
 
-static int address_counter = 0; // É responsável por determinar a posição em memória de uma variável no momento da adição na tabela.
+// Hash index
+// ----------------------------------------------------------------------------
+
+// Endereçamento aberto com sondagem linear. Cada posição guarda o hash da
+// chave junto com o índice da entrada na tabela dona, assim o índice pode
+// crescer sem consultar a tabela e a maior parte das sondagens falhas nem
+// chega a comparar nomes.
+typedef struct {
+    unsigned hash;
+    int idx; /* -1 se a posição está vazia. */
+} Slot;
+
+typedef struct {
+    Slot* slots;
+    unsigned mask; /* capacidade - 1, sempre potência de 2. */
+    int count;
+} Index;
+
+#define INDEX_INITIAL_CAPACITY 64
+
+static void index_init(Index* ix) {
+    ix->slots = malloc(INDEX_INITIAL_CAPACITY * sizeof(Slot));
+    for (int i = 0; i < INDEX_INITIAL_CAPACITY; i++) {
+        ix->slots[i].idx = -1;
+    }
+    ix->mask = INDEX_INITIAL_CAPACITY - 1;
+    ix->count = 0;
+}
+
+static void index_put(Index* ix, unsigned hash, int idx) {
+    unsigned i = hash & ix->mask;
+    while (ix->slots[i].idx != -1) {
+        i = (i + 1) & ix->mask;
+    }
+    ix->slots[i].hash = hash;
+    ix->slots[i].idx = idx;
+}
+
+// Insere sem checar repetições; mantém a ocupação abaixo de 1/2.
+static void index_add(Index* ix, unsigned hash, int idx) {
+    if (2 * (ix->count + 1) > (int) ix->mask + 1) {
+        Slot* old = ix->slots;
+        unsigned old_capacity = ix->mask + 1;
+        unsigned capacity = 2 * old_capacity;
+        ix->slots = malloc(capacity * sizeof(Slot));
+        for (unsigned i = 0; i < capacity; i++) {
+            ix->slots[i].idx = -1;
+        }
+        ix->mask = capacity - 1;
+        for (unsigned i = 0; i < old_capacity; i++) {
+            if (old[i].idx != -1) {
+                index_put(ix, old[i].hash, old[i].idx);
+            }
+        }
+        free(old);
+    }
+    index_put(ix, hash, idx);
+    ix->count++;
+}
+
+// Percorre as entradas candidatas para o hash dado: a primeira chamada usa
+// *pos == hash, as seguintes continuam de onde a anterior parou.
+// Retorna -1 quando não há mais candidatas.
+static int index_next(Index* ix, unsigned hash, unsigned* pos) {
+    for (unsigned i = *pos & ix->mask; ix->slots[i].idx != -1; i = (i + 1) & ix->mask) {
+        if (ix->slots[i].hash == hash) {
+            *pos = i + 1;
+            return ix->slots[i].idx;
+        }
+    }
+    return -1;
+}
+
+static void index_free(Index* ix) {
+    free(ix->slots);
+}
+
+// FNV-1a.
+static unsigned hash_str(const char* s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned hash_pair(int a, int b) {
+    unsigned h = (unsigned) a * 2654435761u;
+    return (h ^ (h >> 15)) + (unsigned) b * 40503u;
+}
 
 // Strings Table
 // ----------------------------------------------------------------------------
 
-#define STRING_MAX_SIZE 128
-#define STRINGS_TABLE_MAX_SIZE 100
-
 struct str_table {
-    char t[STRINGS_TABLE_MAX_SIZE][STRING_MAX_SIZE];
+    char** t;
     int size;
+    int capacity;
+    Index index;
 };
 
 StrTable* create_str_table() {
     StrTable *st = malloc(sizeof * st);
+    st->t = NULL;
     st->size = 0;
+    st->capacity = 0;
+    index_init(&st->index);
     return st;
 }
 
-int add_string(StrTable* st, char* s) {
-    for (int i = 0; i < st->size; i++) {
+int find_string(StrTable* st, char* s) {
+    unsigned h = hash_str(s);
+    unsigned pos = h;
+    int i;
+    while ((i = index_next(&st->index, h, &pos)) != -1) {
         if (strcmp(st->t[i], s) == 0) {
             return i;
         }
     }
-    strcpy(st->t[st->size], s);
-    int idx_added = st->size;
-    st->size++;
-    return idx_added;
+    return -1;
+}
+
+int add_string(StrTable* st, char* s) {
+    int i = find_string(st, s);
+    if (i != -1) {
+        return i;
+    }
+    if (st->size == st->capacity) {
+        st->capacity = st->capacity == 0 ? 64 : 2 * st->capacity;
+        st->t = realloc(st->t, st->capacity * sizeof(char*));
+    }
+    st->t[st->size] = strdup(s);
+    index_add(&st->index, hash_str(s), st->size);
+    return st->size++;
+}
+
+int add_literal(StrTable* st, char* text) {
+    size_t len = strlen(text);
+    char* s = malloc(len + 1);
+    size_t j = 0;
+    // As aspas só aparecem nas pontas (ver scanner.l); qualquer outra
+    // barra invertida fica como está.
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '"') {
+            continue;
+        }
+        if (text[i] == '\\' && text[i + 1] == 'n') {
+            s[j++] = '\n';
+            i++;
+        }
+        else {
+            s[j++] = text[i];
+        }
+    }
+    s[j] = '\0';
+    int idx = add_string(st, s);
+    free(s);
+    return idx;
 }
 
 char* get_string(StrTable* st, int i) {
@@ -48,89 +177,124 @@ void print_str_table(StrTable* st) {
 }
 
 void free_str_table(StrTable* st) {
+    for (int i = 0; i < st->size; i++) {
+        free(st->t[i]);
+    }
+    free(st->t);
+    index_free(&st->index);
     free(st);
 }
 
 // Variables Table
 // ----------------------------------------------------------------------------
 
-#define VARIABLE_MAX_SIZE 128
-#define VARIABLES_TABLE_MAX_SIZE 100
+// Campos lidos durante a execução e a compilação, num vetor compacto.
+typedef struct {
+  int addr;
+  int size;
+  int scope;
+} VarHot;
 
+// Campos só usados pelo front-end e nas mensagens de erro.
 typedef struct {
-  char name[VARIABLE_MAX_SIZE];
+  int name; /* índice do nome em 'names'. */
   int line;
-  int scope;
-  int size;
-  int addr;
-} Entry;
+} VarCold;
 
 struct var_table {
-    Entry t[VARIABLES_TABLE_MAX_SIZE];
+    VarHot* hot;
+    VarCold* cold;
     int size;
+    int capacity;
+    StrTable* names; /* tabela de identificadores, compartilhada com o scanner. */
+    Index index; /* chave: (nome, escopo). */
+    int* frame_size; /* número de células já alocadas no registro de ativação de cada escopo. */
+    int scopes;
 };
 
-VarTable* create_var_table() {
+VarTable* create_var_table(StrTable* names) {
     VarTable *vt = malloc(sizeof * vt);
+    vt->hot = NULL;
+    vt->cold = NULL;
     vt->size = 0;
+    vt->capacity = 0;
+    vt->names = names;
+    index_init(&vt->index);
+    vt->frame_size = NULL;
+    vt->scopes = 0;
     return vt;
 }
 
-int lookup_var(VarTable* vt, char* s, int scope) {
-    for (int i = 0; i < vt->size; i++) {
-        if (strcmp(vt->t[i].name, s) == 0 && scope == vt->t[i].scope)  {
+int lookup_var(VarTable* vt, int name, int scope) {
+    unsigned h = hash_pair(name, scope);
+    unsigned pos = h;
+    int i;
+    while ((i = index_next(&vt->index, h, &pos)) != -1) {
+        if (vt->cold[i].name == name && vt->hot[i].scope == scope) {
             return i;
         }
     }
     return -1;
 }
 
-int add_var(VarTable* vt, char* s, int line, int scope, int size) {
-    strcpy(vt->t[vt->size].name, s);
-    vt->t[vt->size].line = line;
-    vt->t[vt->size].scope = scope;
-    vt->t[vt->size].size = size;
-    
-    if(size != -1){
-        vt->t[vt->size].addr = address_counter;
-        if(size == 0){ // é uma variável simples.
-            address_counter++;
-        }
-        else{ // é um vetor.
-            address_counter += size;
+int add_var(VarTable* vt, int name, int line, int scope, int size) {
+    if (vt->size == vt->capacity) {
+        vt->capacity = vt->capacity == 0 ? 64 : 2 * vt->capacity;
+        vt->hot = realloc(vt->hot, vt->capacity * sizeof(VarHot));
+        vt->cold = realloc(vt->cold, vt->capacity * sizeof(VarCold));
+    }
+
+    int idx_added = vt->size;
+    vt->cold[idx_added].name = name;
+    vt->cold[idx_added].line = line;
+    vt->hot[idx_added].scope = scope;
+    vt->hot[idx_added].size = size;
+    index_add(&vt->index, hash_pair(name, scope), idx_added);
+
+    if(scope >= vt->scopes){
+        int scopes = 2 * scope + 1;
+        vt->frame_size = realloc(vt->frame_size, scopes * sizeof(int));
+        for(int i = vt->scopes; i < scopes; i++){
+            vt->frame_size[i] = 0;
         }
+        vt->scopes = scopes;
     }
-    else{ // é uma referência para vetor, portanto não vai para memória.
-        vt->t[vt->size].addr = -1;
+
+    // O endereço é relativo ao início do registro de ativação da função (escopo).
+    vt->hot[idx_added].addr = vt->frame_size[scope];
+    if(size > 0){ // é um vetor.
+        vt->frame_size[scope] += size;
     }
-    
-    int idx_added = vt->size;
+    else{ // é uma variável simples ou uma referência para vetor, cuja célula guarda o endereço base.
+        vt->frame_size[scope]++;
+    }
+
     vt->size++;
     return idx_added;
 }
 
 char* get_name(VarTable* vt, int i) {
-    return vt->t[i].name;
+    return get_string(vt->names, vt->cold[i].name);
 }
 
 int get_line(VarTable* vt, int i) {
-    return vt->t[i].line;
+    return vt->cold[i].line;
 }
 
 int get_size(VarTable* vt, int i) {
-    return vt->t[i].size;
+    return vt->hot[i].size;
 }
 
 int get_scope(VarTable* vt, int i){
-    return vt->t[i].scope;
+    return vt->hot[i].scope;
 }
 
 int get_address(VarTable* vt, int i){
-    return vt->t[i].addr;
+    return vt->hot[i].addr;
 }
 
-void set_address(VarTable* vt, int i, int addr){
-    vt->t[i].addr = addr;
+int get_frame_size(VarTable* vt, int scope){
+    return scope < vt->scopes ? vt->frame_size[scope] : 0;
 }
 
 void print_var_table(VarTable* vt) {
@@ -142,6 +306,10 @@ void print_var_table(VarTable* vt) {
 }
 
 void free_var_table(VarTable* vt) {
+    free(vt->hot);
+    free(vt->cold);
+    index_free(&vt->index);
+    free(vt->frame_size);
     free(vt);
 }
 
@@ -149,66 +317,91 @@ void free_var_table(VarTable* vt) {
 // ----------------------------------------------------------------------------
 
 typedef struct {
-  char name[VARIABLE_MAX_SIZE];
-  int line;
   int arity; /* o número de parâmetros da função. */
+  int scope;
   Type type;
-  AST* node;
-} FuncEntry;
+} FuncHot;
+
+typedef struct {
+  int name; /* índice do nome em 'names'. */
+  int line;
+} FuncCold;
 
 struct func_table {
-    FuncEntry t[VARIABLES_TABLE_MAX_SIZE];
+    FuncHot* hot;
+    FuncCold* cold;
     int size;
+    int capacity;
+    StrTable* names; /* tabela de identificadores, compartilhada com o scanner. */
+    int* by_name; /* índice da função com cada nome, ou -1. Como os nomes já são internados, basta um vetor. */
+    int by_name_size;
 };
 
-FuncTable* create_func_table(){
+FuncTable* create_func_table(StrTable* names){
     FuncTable *ft = malloc(sizeof * ft);
+    ft->hot = NULL;
+    ft->cold = NULL;
     ft->size = 0;
-    return ft;    
+    ft->capacity = 0;
+    ft->names = names;
+    ft->by_name = NULL;
+    ft->by_name_size = 0;
+    return ft;
 }
 
-int add_func(FuncTable* ft, char* s, int line, int arity, Type type){
-    strcpy(ft->t[ft->size].name, s);
-    ft->t[ft->size].line = line;
-    ft->t[ft->size].arity = arity;
-    ft->t[ft->size].type = type;
-    ft->t[ft->size].node = NULL;
+int add_func(FuncTable* ft, int name, int line, int arity, Type type, int scope){
+    if (ft->size == ft->capacity) {
+        ft->capacity = ft->capacity == 0 ? 64 : 2 * ft->capacity;
+        ft->hot = realloc(ft->hot, ft->capacity * sizeof(FuncHot));
+        ft->cold = realloc(ft->cold, ft->capacity * sizeof(FuncCold));
+    }
+
     int idx_added = ft->size;
+    ft->cold[idx_added].name = name;
+    ft->cold[idx_added].line = line;
+    ft->hot[idx_added].arity = arity;
+    ft->hot[idx_added].type = type;
+    ft->hot[idx_added].scope = scope;
+
+    if (name >= ft->by_name_size) {
+        int by_name_size = 2 * name + 64;
+        ft->by_name = realloc(ft->by_name, by_name_size * sizeof(int));
+        for (int i = ft->by_name_size; i < by_name_size; i++) {
+            ft->by_name[i] = -1;
+        }
+        ft->by_name_size = by_name_size;
+    }
+    ft->by_name[name] = idx_added;
     ft->size++;
     return idx_added;
 }
 
-int lookup_func(FuncTable* ft, char* s){
-    for (int i = 0; i < ft->size; i++) {
-        if (strcmp(ft->t[i].name, s) == 0)  {
-            return i;
-        }
-    }
-    return -1;
+int lookup_func(FuncTable* ft, int name){
+    return name >= 0 && name < ft->by_name_size ? ft->by_name[name] : -1;
 }
 
 char* get_func_name(FuncTable* ft, int i){
-    return ft->t[i].name;
+    return get_string(ft->names, ft->cold[i].name);
 }
 
 int get_func_line(FuncTable* ft, int i){
-    return ft->t[i].line;
+    return ft->cold[i].line;
 }
 
 int get_func_arity(FuncTable* ft, int i){
-    return ft->t[i].arity;
+    return ft->hot[i].arity;
 }
 
 int get_func_type(FuncTable* ft, int i){
-    return ft->t[i].type;
+    return ft->hot[i].type;
 }
 
-void add_func_node(FuncTable* ft, int i, AST* node){
-    ft->t[i].node = node;
+int get_func_scope(FuncTable* ft, int i){
+    return ft->hot[i].scope;
 }
 
-AST* get_func_node(FuncTable* ft, int i){
-    return ft->t[i].node;
+int get_func_count(FuncTable* ft){
+    return ft->size;
 }
 
 void print_func_table(FuncTable* ft){
@@ -220,5 +413,8 @@ void print_func_table(FuncTable* ft){
 }
 
 void free_func_table(FuncTable* ft){
+    free(ft->hot);
+    free(ft->cold);
+    free(ft->by_name);
     free(ft);
 }
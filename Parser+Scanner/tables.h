@@ -9,7 +9,8 @@
 // ----------------------------------------------------------------------------
 
 // Opaque structure.
-// For simplicity, the table is implemented as a sequential list.
+// Strings are interned: each distinct string is stored once and found
+// through a hash index, so lookups don't depend on the table size.
 struct str_table;
 typedef struct str_table StrTable;
 
@@ -21,6 +22,14 @@ StrTable* create_str_table();
 // Returns the index of the string in the table.
 int add_string(StrTable* st, char* s);
 
+// Adds a string literal as written in the source: the quotes are removed and
+// \n escapes become line breaks, so the stored string can be written as is.
+// Returns the index of the decoded string in the table.
+int add_literal(StrTable* st, char* text);
+
+// Returns the index of the given string or -1 if it was never added.
+int find_string(StrTable* st, char* s);
+
 // Returns a pointer to the string stored at index 'i'.
 char* get_string(StrTable* st, int i);
 
@@ -35,21 +44,25 @@ void free_str_table(StrTable* st);
 // ----------------------------------------------------------------------------
 
 // Opaque structure.
-// For simplicity, the table is implemented as a sequential list.
-// This table only stores the variable name and type, and its declaration line.
+// Variable names are handles into a shared identifiers table (a StrTable
+// filled by the scanner), and variables are indexed by (name, scope) in a
+// hash table that grows as needed.
+// The fields read at run time (address, size, scope) are kept in a compact
+// array apart from the name and declaration line.
 struct var_table;
 typedef struct var_table VarTable;
 
-// Creates an empty variables table.
-VarTable* create_var_table();
+// Creates an empty variables table whose names are indices into 'names'.
+// The identifiers table is not owned by the variables table.
+VarTable* create_var_table(StrTable* names);
 
 // Adds a fresh var to the table.
 // No check is made by this function, so make sure to call 'lookup_var' first.
 // Returns the index where the variable was inserted.
-int add_var(VarTable* vt, char* s, int line, int scope, int size);
+int add_var(VarTable* vt, int name, int line, int scope, int size);
 
 // Returns the index where the given variable is stored or -1 otherwise.
-int lookup_var(VarTable* vt, char* s, int scope);
+int lookup_var(VarTable* vt, int name, int scope);
 
 // Returns the variable name stored at the given index.
 // No check is made by this function, so make sure that the index is valid first.
@@ -64,8 +77,15 @@ int get_line(VarTable* vt, int i);
 int get_size(VarTable* vt, int i);
 
 int get_scope(VarTable* vt, int i);
+
+// Returns the variable address relative to the start of its function's
+// activation record. Array parameters also get one cell, holding the
+// absolute address of the array passed by the caller.
 int get_address(VarTable* vt, int i);
-void set_address(VarTable* vt, int i, int addr);
+
+// Returns the number of memory cells needed by an activation record of the
+// given scope (all its parameters and local variables).
+int get_frame_size(VarTable* vt, int scope);
 
 // Prints the given table to stdout.
 void print_var_table(VarTable* vt);
@@ -76,19 +96,21 @@ void free_var_table(VarTable* vt);
 // Functions Table
 // ----------------------------------------------------------------------------
 
+// Opaque structure.
+// Function names are handles into the same identifiers table as variables.
 struct func_table;
 typedef struct func_table FuncTable;
 
-// Creates an empty functions table.
-FuncTable* create_func_table();
+// Creates an empty functions table whose names are indices into 'names'.
+FuncTable* create_func_table(StrTable* names);
 
 // Adds a fresh func to the table.
 // No check is made by this function, so make sure to call 'lookup_func' first.
 // Returns the index where the function was inserted.
-int add_func(FuncTable* ft, char* s, int line, int arity, Type type);
+int add_func(FuncTable* ft, int name, int line, int arity, Type type, int scope);
 
 // Returns the index where the given function is stored or -1 otherwise.
-int lookup_func(FuncTable* ft, char* s);
+int lookup_func(FuncTable* ft, int name);
 
 // Returns the function name stored at the given index.
 // No check is made by this function, so make sure that the index is valid first.
@@ -104,8 +126,12 @@ int get_func_arity(FuncTable* ft, int i);
 
 int get_func_type(FuncTable* ft, int i);
 
-void add_func_node(FuncTable* ft, int i, AST* node);
-AST* get_func_node(FuncTable* ft, int i);
+// Returns the scope of the function's parameters and local variables.
+int get_func_scope(FuncTable* ft, int i);
+
+// Returns the number of functions in the table (valid indices are 0 to n - 1).
+int get_func_count(FuncTable* ft);
+
 
 // Prints the given table to stdout.
 void print_func_table(FuncTable* ft);
@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "trace.h"
+#include "ast.h"
+#include "bytecode.h"
+
+int tracing = 0;
+TraceHeader* trace_header = NULL;
+TraceRecord* trace_ring = NULL;
+uint32_t trace_mask = 0;
+
+static size_t mapped_size = 0;
+
+// Sinais fatais -------------------------------------------------------------
+
+// O handler só escreve uma mensagem pronta e devolve o sinal ao padrão: os
+// registros já estão no arquivo. Ele roda numa pilha própria, porque o caso
+// mais comum é justamente a pilha do C estourando numa recursão profunda.
+static char crash_msg[512];
+static size_t crash_len = 0;
+static char alt_stack[1 << 16];
+
+static void on_fatal(int sig) {
+    ssize_t ignored = write(STDERR_FILENO, crash_msg, crash_len);
+    (void) ignored;
+    raise(sig);
+}
+
+static void catch_fatal_signals(char* path) {
+    crash_len = snprintf(crash_msg, sizeof crash_msg,
+                         "trace: fatal signal; the last events are in %s (see tracedump)\n", path);
+    if (crash_len >= sizeof crash_msg) {
+        crash_len = sizeof crash_msg - 1;
+    }
+
+    stack_t ss;
+    ss.ss_sp = alt_stack;
+    ss.ss_size = sizeof alt_stack;
+    ss.ss_flags = 0;
+    sigaltstack(&ss, NULL);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_fatal;
+    sa.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    int fatal[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    for (size_t i = 0; i < sizeof fatal / sizeof fatal[0]; i++) {
+        sigaction(fatal[i], &sa, NULL);
+    }
+}
+
+// Arquivo -------------------------------------------------------------------
+
+static void trace_finish(void) {
+    tracing = 0;
+    munmap(trace_header, mapped_size);
+    trace_header = NULL;
+    trace_ring = NULL;
+}
+
+void trace_start(char* path, int events, FuncTable* ft, TraceEngine engine) {
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t) events) {
+        capacity *= 2;
+    }
+    int kind_count = engine == TRACE_AST ? NODE_KIND_COUNT : OP_COUNT;
+    int func_count = get_func_count(ft);
+
+    size_t names_size = 0;
+    for (int k = 0; k < kind_count; k++) {
+        names_size += strlen(engine == TRACE_AST ? kind2str((NodeKind) k) : op2str((OpCode) k)) + 1;
+    }
+    for (int f = 0; f < func_count; f++) {
+        names_size += strlen(get_func_name(ft, f)) + 1;
+    }
+    size_t names_offset = sizeof(TraceHeader);
+    size_t records_offset = (names_offset + names_size + 15) & ~(size_t) 15;
+    mapped_size = records_offset + (size_t) capacity * sizeof(TraceRecord);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, mapped_size) == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    void* base = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    trace_header = base;
+    memcpy(trace_header->magic, TRACE_MAGIC, 8);
+    strcpy(trace_header->engine, engine == TRACE_AST ? "ast" : "vm");
+    trace_header->record_size = sizeof(TraceRecord);
+    trace_header->capacity = capacity;
+    trace_header->kind_count = kind_count;
+    trace_header->func_count = func_count;
+    trace_header->names_offset = names_offset;
+    trace_header->records_offset = records_offset;
+    trace_header->head = 0;
+
+    char* names = (char*) base + names_offset;
+    for (int k = 0; k < kind_count; k++) {
+        char* name = engine == TRACE_AST ? kind2str((NodeKind) k) : op2str((OpCode) k);
+        names = stpcpy(names, name) + 1;
+    }
+    for (int f = 0; f < func_count; f++) {
+        names = stpcpy(names, get_func_name(ft, f)) + 1;
+    }
+
+    trace_ring = (TraceRecord*) ((char*) base + records_offset);
+    trace_mask = capacity - 1;
+    tracing = 1;
+    catch_fatal_signals(path);
+    atexit(trace_finish);
+}
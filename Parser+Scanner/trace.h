@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "tables.h"
+
+// Execution trace (--trace FILE).
+// ----------------------------------------------------------------------------
+
+// The trace file is mapped into memory and the engine writes one fixed-size
+// record per step (AST node visited or VM instruction executed) into a ring
+// inside it, overwriting the oldest ones. There is a single writer and no
+// lock: 'head' is published after each record, so tracedump can read the
+// file while the program runs, and the last events are still there after a
+// crash, since the pages belong to the file and not to the process.
+// Like --stats, the engines check for tracing once per run: without --trace
+// they execute exactly the same code as before.
+
+#define TRACE_MAGIC "CMTRACE1"
+
+// Default ring size, in records.
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+
+typedef struct {
+    uint32_t kind;  // NodeKind for the AST walker, OpCode for the VM
+    int32_t func;   // index in the ft of the function being executed (-1 outside main)
+    int32_t depth;  // data stack depth, in cells, before the step
+    int32_t top;    // value on top of the data stack (0 if it is empty)
+} TraceRecord;
+
+// The file is this header, the names and the ring. The names section holds
+// kind_count kind names followed by func_count function names, each one
+// terminated by '\0', so the file can be decoded without the program.
+typedef struct {
+    char magic[8];
+    char engine[8];          // "ast" or "vm": what 'kind' means
+    uint32_t record_size;    // sizeof(TraceRecord)
+    uint32_t capacity;       // records in the ring, a power of two
+    uint32_t kind_count;
+    uint32_t func_count;
+    uint32_t names_offset;
+    uint32_t records_offset;
+    uint64_t head;           // records written so far; the next one goes to head % capacity
+} TraceHeader;
+
+typedef enum {
+    TRACE_AST,
+    TRACE_VM
+} TraceEngine;
+
+extern int tracing;
+extern TraceHeader* trace_header;
+extern TraceRecord* trace_ring;
+extern uint32_t trace_mask;
+
+static inline void trace_event(int kind, int func, int depth, int top) {
+    uint64_t n = trace_header->head;
+    TraceRecord* r = &trace_ring[n & trace_mask];
+    r->kind = kind;
+    r->func = func;
+    r->depth = depth;
+    r->top = top;
+    __atomic_store_n(&trace_header->head, n + 1, __ATOMIC_RELEASE);
+}
+
+// Creates 'path' with a ring of at least 'events' records (rounded up to a
+// power of two) and turns tracing on for the given engine. The kind and
+// function names are written to the file right away.
+// A fatal signal (SIGSEGV, SIGFPE, ...) prints where the trace is before
+// the process dies.
+void trace_start(char* path, int events, FuncTable* ft, TraceEngine engine);
+
+#endif // TRACE_H
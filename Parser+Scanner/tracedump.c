@@ -0,0 +1,131 @@
+// Decodificador do trace de execução (trab5 --trace FILE).
+// Imprime os últimos N passos gravados no anel. Pode ser usado com o programa
+// ainda rodando ou depois que ele terminou, normalmente ou não.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define DEFAULT_COUNT 32
+
+static void usage(char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n N] FILE\n"
+            "  -n N    print the last N steps (default %d, 0 = all that are kept)\n",
+            argv0, DEFAULT_COUNT);
+    exit(EXIT_FAILURE);
+}
+
+static void bad_file(char* path) {
+    fprintf(stderr, "%s: not a trace file\n", path);
+    exit(EXIT_FAILURE);
+}
+
+// Separa a seção de nomes em 'count' strings, sem sair do arquivo.
+static char** split_names(char* path, char* p, char* end, int count) {
+    char** names = malloc((count + 1) * sizeof(char*));
+    for (int i = 0; i < count; i++) {
+        char* nul = memchr(p, '\0', end - p);
+        if (nul == NULL) {
+            bad_file(path);
+        }
+        names[i] = p;
+        p = nul + 1;
+    }
+    return names;
+}
+
+int main(int argc, char* argv[]) {
+    long count = DEFAULT_COUNT;
+    char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            char* end;
+            count = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || count < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    if ((size_t) info.st_size < sizeof(TraceHeader)) {
+        bad_file(path);
+    }
+    char* base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    TraceHeader* h = (TraceHeader*) base;
+    if (memcmp(h->magic, TRACE_MAGIC, 8) != 0 || h->record_size != sizeof(TraceRecord)
+        || h->capacity == 0 || (h->capacity & (h->capacity - 1)) != 0
+        || h->records_offset < h->names_offset || h->names_offset < sizeof(TraceHeader)
+        || h->records_offset + (size_t) h->capacity * sizeof(TraceRecord) > (size_t) info.st_size) {
+        bad_file(path);
+    }
+    char** kinds = split_names(path, base + h->names_offset, base + h->records_offset,
+                               h->kind_count + h->func_count);
+    char** funcs = kinds + h->kind_count;
+    TraceRecord* ring = (TraceRecord*) (base + h->records_offset);
+    uint64_t mask = h->capacity - 1;
+
+    // O programa pode estar escrevendo: copia os registros e depois descarta
+    // os que ele sobrescreveu durante a cópia.
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    uint64_t kept = head < h->capacity ? head : h->capacity;
+    if (count == 0 || (uint64_t) count > kept) {
+        count = kept;
+    }
+    uint64_t first = head - count;
+    TraceRecord* copy = malloc((count > 0 ? count : 1) * sizeof(TraceRecord));
+    for (uint64_t n = first; n < head; n++) {
+        copy[n - first] = ring[n & mask];
+    }
+    uint64_t now = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    uint64_t valid = now > h->capacity ? now - h->capacity : 0;
+    if (valid > first) {
+        valid = valid < head ? valid : head;
+    }
+    else {
+        valid = first;
+    }
+
+    int is_vm = strncmp(h->engine, "vm", sizeof h->engine) == 0;
+    printf("%.8s trace: %llu steps recorded, ", h->engine, (unsigned long long) head);
+    printf("%s %llu:\n", head - valid < (uint64_t) count ? "the last intact" : "the last",
+           (unsigned long long) (head - valid));
+    printf("%12s  %-16s %8s %12s  %s\n", "step", "function", "depth", "top", is_vm ? "instruction" : "node");
+    for (uint64_t n = valid; n < head; n++) {
+        TraceRecord* r = &copy[n - first];
+        char* func = r->func >= 0 && (uint32_t) r->func < h->func_count ? funcs[r->func] : "-";
+        char* kind = r->kind < h->kind_count ? kinds[r->kind] : "?";
+        printf("%12llu  %-16s %8d %12d  %s\n", (unsigned long long) n, func, r->depth, r->top, kind);
+    }
+
+    free(copy);
+    free(kinds);
+    munmap(base, info.st_size);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,316 @@
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
+#include "tables.h"
+#include "trace.h"
+
+static int vm_stack[VM_STACK_SIZE];
+static Frame vm_calls[VM_CALL_STACK_SIZE];
+static int vm_mem[VM_MEM_SIZE];
+static int* func_at = NULL; // só com --stats ou --trace: função cujo ENTER está em cada endereço
+static int call_func[VM_CALL_STACK_SIZE]; // só com --trace: função de cada chamada, no ft
+
+// Fora do laço principal: código a mais no switch, mesmo que nunca rode sem
+// --profile, piora a alocação de registradores das outras instruções.
+static __attribute__((noinline, cold)) void run_profile_op(Instr* in) {
+    switch (in->op) {
+        case OP_PROF_ENTER: profile_enter(in->arg);     break;
+        case OP_PROF_TAIL:  profile_replace(in->arg);   break;
+        default:            profile_leave();            break;
+    }
+}
+
+// Erro de execução: a cópia embutida (libcminus) devolve -1 com a mensagem em
+// m->error; as do trab5 encerram o processo, como sempre.
+#define VM_FAIL(...)                                                    \
+    do {                                                                \
+        if (embedded) {                                                 \
+            snprintf(m->error, sizeof m->error, __VA_ARGS__);           \
+            m->mem_used = high;                                         \
+            return -1;                                                  \
+        }                                                               \
+        io_flush();                                                     \
+        fprintf(stderr, __VA_ARGS__);                                   \
+        fputc('\n', stderr);                                            \
+        exit(EXIT_FAILURE);                                             \
+    } while (0)
+
+// Só a cópia embutida confere a pilha de dados e os acessos a vetores: um
+// programa com erro não pode escrever fora da memória da máquina e estragar
+// o processo que a hospeda. Todo elemento de vetor válido está num registro
+// de ativação vivo, ou seja, abaixo de top.
+#define CHECK_PUSH()                                                    \
+    if (embedded && sp + 1 >= VM_STACK_SIZE) VM_FAIL("Data stack overflow!")
+#define CHECK_INDEX(addr)                                               \
+    if (embedded && (unsigned) (addr) >= (unsigned) top) VM_FAIL("Array index out of bounds!")
+
+// O laço é escrito uma vez e especializado três vezes: com 'instrumented' e
+// 'embedded' constantes, a cópia normal não tem nenhum vestígio dos
+// contadores do --stats e do --trace nem das checagens e callbacks da
+// libcminus. A cópia embutida roda sobre a memória de m; as outras, sobre os
+// vetores estáticos acima.
+static inline __attribute__((always_inline)) int execute(Bytecode* bc, VmMachine* m,
+                                                         const int instrumented, const int embedded) {
+    Instr* code = bc->code;
+    int* stack = embedded ? m->stack : vm_stack;
+    Frame* calls = embedded ? m->calls : vm_calls;
+    int* mem = embedded ? m->mem : vm_mem;
+    int sp = -1;
+    int csp = -1;
+    int pc = 0;
+    int fp = 0;
+    int top = 0; // primeira célula livre depois do registro corrente
+    int high = 0; // maior top da execução: só a cópia embutida o acompanha
+    int l, r, i;
+
+    if (embedded) {
+        // Só o que a execução anterior usou pode estar sujo.
+        memset(mem, 0, m->mem_used * sizeof(int));
+        m->mem_used = 0;
+    }
+    else {
+        for (int addr = 0; addr < VM_MEM_SIZE; addr++) {
+            mem[addr] = 0;
+        }
+    }
+
+    // Assim como no interpretador da AST, o trab5 não checa os limites da pilha de dados.
+    for (;;) {
+        Instr* in = &code[pc++];
+        if (instrumented) {
+            if (tracing) {
+                trace_event(in->op, csp >= 0 ? call_func[csp] : -1, sp + 1, sp >= 0 ? stack[sp] : 0);
+            }
+            if (stats_enabled) {
+                run_stats.steps++;
+                run_stats.by_op[in->op]++;
+                if (sp + 1 > run_stats.max_stack) {
+                    run_stats.max_stack = sp + 1;
+                }
+            }
+        }
+        switch (in->op) {
+            case OP_HALT:
+                if (embedded) {
+                    m->mem_used = high;
+                }
+                return 0;
+
+            case OP_PUSH:   CHECK_PUSH(); stack[++sp] = in->arg;           break;
+            case OP_POP:    sp--;                                          break;
+            case OP_LOAD:   CHECK_PUSH(); stack[++sp] = mem[fp + in->arg]; break;
+            case OP_STORE:  mem[fp + in->arg] = stack[sp--];               break;
+            case OP_ADDR:   CHECK_PUSH(); stack[++sp] = fp + in->arg;      break;
+
+            case OP_LOADX:
+                i = fp + in->arg + stack[sp];
+                CHECK_INDEX(i);
+                stack[sp] = mem[i];
+                break;
+            case OP_STOREX:
+                i = fp + in->arg + stack[sp--];
+                CHECK_INDEX(i);
+                mem[i] = stack[sp--];
+                break;
+            case OP_LOADR:
+                i = mem[fp + in->arg] + stack[sp];
+                CHECK_INDEX(i);
+                stack[sp] = mem[i];
+                break;
+            case OP_STORER:
+                i = mem[fp + in->arg] + stack[sp--];
+                CHECK_INDEX(i);
+                mem[i] = stack[sp--];
+                break;
+
+            #define BIN_OP(expr) r = stack[sp--]; l = stack[sp]; stack[sp] = (expr); break
+            case OP_ADD:    BIN_OP(l + r);
+            case OP_SUB:    BIN_OP(l - r);
+            case OP_MUL:    BIN_OP(l * r);
+            case OP_DIV:
+                r = stack[sp--];
+                l = stack[sp];
+                if (embedded && r == 0) {
+                    VM_FAIL("Division by zero!");
+                }
+                if (embedded && r == -1 && l == INT_MIN) {
+                    VM_FAIL("Division overflow!");
+                }
+                stack[sp] = l / r;
+                break;
+            case OP_SHL:    BIN_OP((int) ((unsigned) l << r));
+            case OP_EQ:     BIN_OP(l == r);
+            case OP_NEQ:    BIN_OP(l != r);
+            case OP_LT:     BIN_OP(l < r);
+            case OP_LE:     BIN_OP(l <= r);
+            case OP_GT:     BIN_OP(l > r);
+            case OP_GE:     BIN_OP(l >= r);
+            #undef BIN_OP
+
+            case OP_JMP:
+                pc = in->arg;
+                break;
+            case OP_JZ:
+                if (stack[sp--] == 0) {
+                    pc = in->arg;
+                }
+                break;
+
+            case OP_CALL:
+                if (csp == VM_CALL_STACK_SIZE - 1) {
+                    VM_FAIL("Call stack overflow!");
+                }
+                csp++;
+                calls[csp].pc = pc;
+                calls[csp].fp = fp;
+                fp = top;
+                pc = in->arg;
+                break;
+            case OP_TAILCALL:
+                // O ENTER da função chamada redimensiona o registro corrente.
+                pc = in->arg;
+                break;
+            case OP_ENTER:
+                calls[csp].sp = sp - in->arg2;
+                top = fp + in->arg;
+                if (instrumented) {
+                    call_func[csp] = func_at[pc - 1];
+                    if (stats_enabled) {
+                        run_stats.calls[func_at[pc - 1]]++;
+                        if (top > run_stats.max_mem) {
+                            run_stats.max_mem = top;
+                        }
+                    }
+                }
+                if (top > VM_MEM_SIZE) {
+                    VM_FAIL("Stack overflow!");
+                }
+                if (embedded && top > high) {
+                    high = top;
+                }
+                // Variáveis locais começam zeradas, mesmo num registro
+                // reaproveitado. Os parâmetros ocupam as primeiras células e
+                // são escritos logo depois, com STORE.
+                if (in->arg > in->arg2) {
+                    memset(&mem[fp + in->arg2], 0, (in->arg - in->arg2) * sizeof(int));
+                }
+                break;
+            case OP_RET:
+                // Deixa só o valor de retorno acima da base da chamada.
+                i = stack[sp];
+                sp = calls[csp].sp;
+                stack[++sp] = i;
+                // O registro do chamador termina onde o da função chamada começava.
+                top = fp;
+                pc = calls[csp].pc;
+                fp = calls[csp].fp;
+                csp--;
+                break;
+
+            case OP_INPUT:
+                CHECK_PUSH();
+                if (embedded) {
+                    if (m->io.input(m->io.user, &i) != 0) {
+                        VM_FAIL("input(): no more input");
+                    }
+                    stack[++sp] = i;
+                }
+                else {
+                    stack[++sp] = io_input();
+                }
+                break;
+            case OP_OUTPUT:
+                if (embedded) {
+                    m->io.output(m->io.user, stack[sp--]);
+                }
+                else {
+                    io_write_int(stack[sp--]);
+                }
+                break;
+            case OP_WRITE:
+                if (embedded) {
+                    m->io.write(m->io.user, get_string(bc->strings, in->arg));
+                }
+                else {
+                    io_write(get_string(bc->strings, in->arg));
+                }
+                break;
+
+            case OP_PROF_ENTER:
+            case OP_PROF_TAIL:
+            case OP_PROF_LEAVE:
+                run_profile_op(in);
+                break;
+
+            default:
+                VM_FAIL("Invalid opcode: %d!", in->op);
+        }
+    }
+}
+
+// As chamadas são contadas (e a função corrente do trace muda) no ENTER, que
+// também é onde as chamadas em cauda entram.
+static __attribute__((noinline)) void run_instrumented(Bytecode* bc) {
+    func_at = malloc(bc->size * sizeof(int));
+    for (int f = 0; f < bc->func_count; f++) {
+        func_at[bc->entry[f]] = f;
+    }
+    execute(bc, NULL, 1, 0);
+    free(func_at);
+    func_at = NULL;
+}
+
+// A cópia normal fica aqui mesmo: isolada numa função noinline ela ficou
+// 10-20% mais lenta, só pela posição do código. Pelo mesmo motivo o teste é
+// um campo só do bytecode: com 'stats_enabled || tracing' o gcc passou a
+// estender o pc para 64 bits a cada instrução. E ela não é expandida dentro
+// de main (LTO): lá, disputando registradores com as variáveis de main, o
+// ponteiro do código ia para a pilha e era relido a cada instrução.
+__attribute__((noinline)) void run_bytecode(Bytecode* bc) {
+    if (bc->instrumented) {
+        run_instrumented(bc);
+    }
+    else {
+        execute(bc, NULL, 0, 0);
+    }
+}
+
+// Máquinas da libcminus ------------------------------------------------------
+
+// calloc: as páginas só são de fato ocupadas quando a execução chega nelas.
+VmMachine* create_machine(CminusIO io) {
+    VmMachine* m = malloc(sizeof * m);
+    if (m == NULL) {
+        return NULL;
+    }
+    m->stack = calloc(VM_STACK_SIZE, sizeof(int));
+    m->calls = calloc(VM_CALL_STACK_SIZE, sizeof(Frame));
+    m->mem = calloc(VM_MEM_SIZE, sizeof(int));
+    if (m->stack == NULL || m->calls == NULL || m->mem == NULL) {
+        free_machine(m);
+        return NULL;
+    }
+    m->mem_used = 0;
+    m->io = io;
+    m->error[0] = '\0';
+    return m;
+}
+
+// Sem --profile, --stats nem --trace: essas opções só existem no trab5.
+int run_machine(Bytecode* bc, VmMachine* m) {
+    m->error[0] = '\0';
+    return execute(bc, m, 0, 1);
+}
+
+void free_machine(VmMachine* m) {
+    free(m->stack);
+    free(m->calls);
+    free(m->mem);
+    free(m);
+}
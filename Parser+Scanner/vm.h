@@ -0,0 +1,45 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "cminus.h"
+
+#define VM_STACK_SIZE (1 << 20)
+#define VM_CALL_STACK_SIZE (1 << 16)
+#define VM_MEM_SIZE (1 << 20)
+#define VM_ERROR_SIZE 256
+
+typedef struct {
+    int pc; // endereço de retorno
+    int fp; // registro de ativação do chamador
+    int sp; // base da pilha de dados da chamada (sem os argumentos)
+} Frame;
+
+// Runs the given bytecode from pc 0 until OP_HALT on the VM's static stacks
+// and memory, with the I/O of io.h. Runtime errors end the process.
+void run_bytecode(Bytecode* bc);
+
+// A VM of its own, for libcminus (see cminus.h): the data stack, the call
+// stack and the memory belong to the machine, so machines running the same
+// bytecode in different threads share nothing but the (read-only) code.
+// Here the data stack and every array access are checked, and a runtime
+// error ends the run instead of the process.
+typedef struct {
+    int* stack;
+    Frame* calls;
+    int* mem;
+    int mem_used;   // cells the last run may have written; zeroed before the next one
+    CminusIO io;    // every callback set
+    char error[VM_ERROR_SIZE];
+} VmMachine;
+
+// Returns NULL if the memory can't be allocated.
+VmMachine* create_machine(CminusIO io);
+
+// Runs bc from main() with zeroed memory. Returns 0 at OP_HALT, or -1 after a
+// runtime error, described in m->error.
+int run_machine(Bytecode* bc, VmMachine* m);
+
+void free_machine(VmMachine* m);
+
+#endif // VM_H